@@ -4,7 +4,12 @@
 
 #define BUILD_DIR "build/"
 
-const char *INPUTS[] = {"src/main.c", "src/parser.c", "src/util.c", "src/diagram.c"};
+const char *INPUTS[] = {
+    "src/main.c", "src/parser.c", "src/util.c", "src/diagram.c",
+    "src/term.c", "src/reduce.c", "src/graph.c", "src/krivine.c", "src/nbe.c",
+    "src/optimal.c", "src/parallel.c", "src/memo.c", "src/dag.c", "src/symbol.c",
+    "src/blc.c",
+};
 const size_t INPUTS_COUNT = sizeof(INPUTS) / sizeof(char *);
 const char *OUTPUT = BUILD_DIR "tromp";
 
@@ -27,6 +32,7 @@ void cflags(Nob_Cmd *cmd, bool debug) {
 
 void libs(Nob_Cmd *cmd) {
   nob_cmd_append(cmd, "-lm");
+  nob_cmd_append(cmd, "-lpthread");
   nob_cmd_append(cmd, "-lraylib");
 }
 
@@ -0,0 +1,193 @@
+#include "blc.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+// Names given to abstractions by depth, cycling; 'l' is left out since it starts an abstraction in the text syntax.
+static const char blc_names[] = "xyzabcdefghijkmnopqrstuvw";
+
+typedef struct {
+  const void *data;
+  size_t count; // in bits
+  size_t position; // next bit to read
+  bool packed;
+  bool invalid; // a bit string held something other than '0' and '1'
+} Blc_Reader;
+
+static bool blc_next(Blc_Reader *reader, unsigned *bit) {
+  if (reader->position >= reader->count) return false;
+  size_t i = reader->position++;
+
+  if (reader->packed) {
+    *bit = (((const uint8_t *)reader->data)[i / 8] >> (7 - i % 8)) & 1;
+    return true;
+  }
+
+  char c = ((const char *)reader->data)[i];
+  if (c != '0' && c != '1') {
+    reader->invalid = true;
+    return false;
+  }
+  *bit = c == '1';
+  return true;
+}
+
+/*
+ * Decodes one term. The code is in preorder and the store wants postorder, so abstractions and applications wait
+ * on a stack for their children: an entry is the number of children its node still needs (1 or 2), and once a
+ * subterm is complete the pending nodes it completes are pushed.
+ */
+static bool blc_read(Term_Store *store, Blc_Reader *reader, Term_Index *root) {
+  typedef struct {
+    Lambda_Expr_Kind kind;
+    uint32_t missing; // children still to be read
+    Term_Index left; // LAMBDA_APPLICATION: the function, once read
+  } Pending;
+
+  Vec(Pending) stack = {0};
+  uint32_t depth = 0; // abstractions on the stack
+  bool ok = false;
+
+  for (;;) {
+    unsigned bit;
+    if (!blc_next(reader, &bit)) goto truncated;
+
+    Term_Index done;
+    if (bit == 0) {
+      if (!blc_next(reader, &bit)) goto truncated;
+      if (bit == 0) {
+        nob_da_append(&stack, ((Pending){.kind = LAMBDA_ABSTRACTION, .missing = 1}));
+        depth += 1;
+      } else {
+        nob_da_append(&stack, ((Pending){.kind = LAMBDA_APPLICATION, .missing = 2}));
+      }
+      continue;
+    }
+
+    uint32_t index = 0;
+    for (;;) {
+      if (!blc_next(reader, &bit)) goto truncated;
+      if (bit == 0) break;
+      index += 1;
+    }
+    if (index >= depth) {
+      fprintf(stderr, "Could not read BLC term. Atom at bit %zu has no binder (index %u under %u abstractions)\n",
+              reader->position, index + 1, depth);
+      goto done;
+    }
+    done = term_push_atom(store, index);
+
+    // Push every pending node this subterm completes.
+    for (;;) {
+      if (stack.count == 0) {
+        *root = done;
+        ok = true;
+        goto done;
+      }
+
+      Pending *top = &stack.items[stack.count - 1];
+      if (top->kind == LAMBDA_APPLICATION && top->missing == 2) {
+        top->missing = 1;
+        top->left = done;
+        break;
+      }
+
+      stack.count -= 1;
+      if (top->kind == LAMBDA_ABSTRACTION) {
+        depth -= 1;
+        done = term_push_abstraction(store, blc_names[depth % (sizeof(blc_names) - 1)], done);
+      } else {
+        done = term_push_application(store, top->left, done);
+      }
+    }
+  }
+
+truncated:
+  if (reader->invalid) {
+    fprintf(stderr, "Could not read BLC term. Expected '0' or '1' at position %zu\n", reader->position - 1);
+  } else {
+    fprintf(stderr, "Could not read BLC term. It ends after %zu bits, in the middle of a term\n", reader->count);
+  }
+
+done:
+  nob_da_free(stack);
+  return ok;
+}
+
+bool blc_read_bits(Term_Store *store, const char *bits, size_t len, Term_Index *root) {
+  Blc_Reader reader = {.data = bits, .count = len};
+  if (!blc_read(store, &reader, root)) return false;
+
+  if (reader.position < len) {
+    fprintf(stderr, "Could not read BLC term. %zu bits left over after the term\n", len - reader.position);
+    return false;
+  }
+  return true;
+}
+
+bool blc_read_bytes(Term_Store *store, const uint8_t *bytes, size_t len, Term_Index *root) {
+  Blc_Reader reader = {.data = bytes, .count = len * 8, .packed = true};
+  if (!blc_read(store, &reader, root)) return false;
+
+  // Only the padding of the last byte may follow the term.
+  if ((reader.position + 7) / 8 < len) {
+    fprintf(stderr, "Could not read BLC term. %zu bytes left over after the term\n", len - (reader.position + 7) / 8);
+    return false;
+  }
+  return true;
+}
+
+typedef struct {
+  Nob_String_Builder *sb;
+  bool packed;
+  size_t bits; // written so far
+} Blc_Writer;
+
+static void blc_put(Blc_Writer *writer, unsigned bit) {
+  if (!writer->packed) {
+    nob_da_append(writer->sb, bit ? '1' : '0');
+  } else {
+    if (writer->bits % 8 == 0) nob_da_append(writer->sb, 0);
+    writer->sb->items[writer->sb->count - 1] |= (char)(bit << (7 - writer->bits % 8));
+  }
+  writer->bits += 1;
+}
+
+// The store is in postorder and the code is in preorder, so the term is walked from its root with a stack.
+static void blc_write(Blc_Writer *writer, const Term_Store *store, Term_Index root) {
+  Vec(Term_Index) stack = {0};
+  nob_da_append(&stack, root);
+
+  while (stack.count > 0) {
+    Term_Node node = store->items[stack.items[--stack.count]];
+    switch (term_kind(node)) {
+    case LAMBDA_ATOM:
+      for (uint32_t i = 0; i <= term_data(node); ++i) blc_put(writer, 1);
+      blc_put(writer, 0);
+      break;
+    case LAMBDA_ABSTRACTION:
+      blc_put(writer, 0);
+      blc_put(writer, 0);
+      nob_da_append(&stack, node.right);
+      break;
+    case LAMBDA_APPLICATION:
+      blc_put(writer, 0);
+      blc_put(writer, 1);
+      nob_da_append(&stack, node.right);
+      nob_da_append(&stack, node.left);
+      break;
+    }
+  }
+
+  nob_da_free(stack);
+}
+
+void blc_write_bits(Nob_String_Builder *sb, const Term_Store *store, Term_Index root) {
+  Blc_Writer writer = {.sb = sb};
+  blc_write(&writer, store, root);
+}
+
+void blc_write_bytes(Nob_String_Builder *sb, const Term_Store *store, Term_Index root) {
+  Blc_Writer writer = {.sb = sb, .packed = true};
+  blc_write(&writer, store, root);
+}
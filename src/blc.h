@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <nob.h>
+
+#include "term.h"
+
+/*
+ * Tromp's binary lambda calculus.
+ *
+ * A term is the prefix code of its de Bruijn form: 00 M for an abstraction, 01 M N for an application and 1^n 0
+ * for the atom bound n abstractions out (so 10 is the innermost binder, de Bruijn index 0 in a Term_Store). The
+ * code is self-delimiting, so a term is read in one pass over its bits with no matching of any kind.
+ *
+ * Terms come either as bit strings, one '0' or '1' character per bit, or packed eight bits to a byte, most
+ * significant bit first, with the last byte padded with zeros. Names do not exist in BLC: abstractions read from it
+ * are named after their depth, and names are dropped when writing.
+ */
+
+bool blc_read_bits(Term_Store *store, const char *bits, size_t len, Term_Index *root);
+bool blc_read_bytes(Term_Store *store, const uint8_t *bytes, size_t len, Term_Index *root);
+void blc_write_bits(Nob_String_Builder *sb, const Term_Store *store, Term_Index root);
+void blc_write_bytes(Nob_String_Builder *sb, const Term_Store *store, Term_Index root);
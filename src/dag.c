@@ -0,0 +1,664 @@
+#include "dag.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nob.h>
+
+#define DAG_INITIAL_CAPACITY 1024
+#define DAG_MAX_UNSHARED ((size_t)TERM_NONE - 1) // nodes a Term_Store can hold, so the most dag_to_term can write
+
+static uint64_t dag_mix(uint64_t hash) {
+  // splitmix64 finalizer
+  hash ^= hash >> 30;
+  hash *= UINT64_C(0xbf58476d1ce4e5b9);
+  hash ^= hash >> 27;
+  hash *= UINT64_C(0x94d049bb133111eb);
+  return hash ^ (hash >> 31);
+}
+
+static uint64_t dag_node_hash(Term_Node node) {
+  return dag_mix(((uint64_t)node.head << 32 | node.left) ^ dag_mix(node.right));
+}
+
+static void dag_grow(Term_Dag *dag) {
+  size_t capacity = dag->capacity > 0 ? dag->capacity * 2 : DAG_INITIAL_CAPACITY;
+  Dag_Index *table = malloc(capacity * sizeof(Dag_Index));
+  assert(table != NULL && "Out of memory");
+  memset(table, 0xff, capacity * sizeof(Dag_Index)); // TERM_NONE
+
+  for (Dag_Index i = 0; i < dag->nodes.count; ++i) {
+    size_t slot = dag_node_hash(dag->nodes.items[i]) & (capacity - 1);
+    while (table[slot] != TERM_NONE) slot = (slot + 1) & (capacity - 1);
+    table[slot] = i;
+  }
+
+  free(dag->table);
+  dag->table = table;
+  dag->capacity = capacity;
+}
+
+Dag_Index dag_intern(Term_Dag *dag, Lambda_Expr_Kind kind, uint32_t data, Dag_Index left, Dag_Index right) {
+  assert(data < (1u << (32 - TERM_KIND_BITS)) && "Term data does not fit in the node head");
+  Term_Node node = {.head = (data << TERM_KIND_BITS) | (uint32_t)kind, .left = left, .right = right};
+  if (2 * (dag->nodes.count + 1) > dag->capacity) dag_grow(dag);
+
+  size_t slot = dag_node_hash(node) & (dag->capacity - 1);
+  for (; dag->table[slot] != TERM_NONE; slot = (slot + 1) & (dag->capacity - 1)) {
+    Term_Node other = dag->nodes.items[dag->table[slot]];
+    if (other.head == node.head && other.left == node.left && other.right == node.right) return dag->table[slot];
+  }
+
+  uint32_t free = 0;
+  switch (kind) {
+  case LAMBDA_ATOM: free = data + 1; break;
+  case LAMBDA_ABSTRACTION: free = dag->free.items[right] > 0 ? dag->free.items[right] - 1 : 0; break;
+  case LAMBDA_APPLICATION: free = max(dag->free.items[left], dag->free.items[right]); break;
+  }
+
+  Dag_Index index = (Dag_Index)dag->nodes.count;
+  nob_da_append(&dag->nodes, node);
+  nob_da_append(&dag->free, free);
+  nob_da_append(&dag->whnf, TERM_NONE);
+  nob_da_append(&dag->normal_form, TERM_NONE);
+  dag->table[slot] = index;
+  return index;
+}
+
+Dag_Index dag_from_term(Term_Dag *dag, const Term_Store *store, Term_Index root) {
+  Term_Index start = term_subterm_start(store, root);
+  Dag_Index *nodes = malloc((root - start + 1) * sizeof(Dag_Index));
+  assert(nodes != NULL && "Out of memory");
+
+  // Postorder, so both children of a node have already been interned when we get to it.
+  for (Term_Index i = start; i <= root; ++i) {
+    Term_Node node = store->items[i];
+    Dag_Index left = (node.left != TERM_NONE) ? nodes[node.left - start] : TERM_NONE;
+    Dag_Index right = (node.right != TERM_NONE) ? nodes[node.right - start] : TERM_NONE;
+    nodes[i - start] = dag_intern(dag, term_kind(node), term_data(node), left, right);
+  }
+
+  Dag_Index result = nodes[root - start];
+  free(nodes);
+  return result;
+}
+
+Term_Index dag_to_term(Term_Store *store, const Term_Dag *dag, Dag_Index root) {
+  typedef struct {
+    Dag_Index node;
+    bool expanded;
+  } Frame;
+
+  Vec(Frame) stack = {0};
+  Vec(Term_Index) results = {0};
+
+  // Shared nodes are written out once per occurrence, the store holds a plain tree.
+  nob_da_append(&stack, ((Frame){.node = root}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    Term_Node node = dag->nodes.items[frame.node];
+
+    if (term_kind(node) == LAMBDA_ATOM) {
+      nob_da_append(&results, term_push_atom(store, term_data(node)));
+    } else if (!frame.expanded) {
+      nob_da_append(&stack, ((Frame){.node = frame.node, .expanded = true}));
+      nob_da_append(&stack, ((Frame){.node = node.right}));
+      if (node.left != TERM_NONE) nob_da_append(&stack, ((Frame){.node = node.left}));
+    } else if (term_kind(node) == LAMBDA_ABSTRACTION) {
+      Term_Index body = results.items[--results.count];
+      nob_da_append(&results, term_push(store, LAMBDA_ABSTRACTION, term_data(node), TERM_NONE, body));
+    } else {
+      Term_Index right = results.items[--results.count];
+      Term_Index left = results.items[--results.count];
+      nob_da_append(&results, term_push_application(store, left, right));
+    }
+  }
+
+  Term_Index result = results.items[0];
+  nob_da_free(stack);
+  nob_da_free(results);
+  return result;
+}
+
+/*
+ * Same grammar as tree_parse_lambda_term, with the binders kept as the depth they were bound at. Iterative like
+ * it: parsed subterms go on a result stack and are combined by the abstraction and application tasks.
+ */
+static bool dag_parse_lambda_term_impl(Term_Dag *dag, const Lambda_Text *text, Dag_Index *root) {
+  typedef enum {
+    DAG_PARSE,
+    DAG_ABSTRACT,
+    DAG_APPLY,
+  } Task_Kind;
+
+  typedef struct {
+    Task_Kind kind;
+    size_t l, r; // DAG_PARSE
+    uint32_t depth; // DAG_PARSE
+    Symbol name; // DAG_ABSTRACT
+    uint32_t shadowed; // DAG_ABSTRACT, binder depth to restore for name
+  } Task;
+
+  Vec(Task) stack = {0};
+  Vec(Dag_Index) results = {0};
+  Vec(uint32_t) binder_depths = {0}; // per symbol, 0 for unbound, else 1 + the abstractions around its binder
+  bool ok = false;
+
+  nob_da_append(&stack, ((Task){.kind = DAG_PARSE, .l = 0, .r = text->len - 1}));
+  while (stack.count > 0) {
+    Task task = stack.items[--stack.count];
+
+    if (task.kind == DAG_ABSTRACT) {
+      binder_depths.items[task.name] = task.shadowed;
+      Dag_Index body = results.items[--results.count];
+      nob_da_append(&results, dag_intern(dag, LAMBDA_ABSTRACTION, task.name, TERM_NONE, body));
+      continue;
+    }
+    if (task.kind == DAG_APPLY) {
+      Dag_Index right = results.items[--results.count];
+      Dag_Index left = results.items[--results.count];
+      nob_da_append(&results, dag_intern(dag, LAMBDA_APPLICATION, 0, left, right));
+      continue;
+    }
+
+    Lambda_Split split;
+    if (!lambda_text_split(text, task.l, task.r, &split)) goto done;
+    while (binder_depths.count < symbol_count()) nob_da_append(&binder_depths, 0);
+
+    switch (split.kind) {
+    case LAMBDA_ATOM: {
+      uint32_t binder = binder_depths.items[split.name];
+      if (binder == 0) {
+        fprintf(stderr, "Could not parse lambda term. Atom '" SV_Fmt "' has no binder in %.*s\n",
+                SV_Arg(symbol_name(split.name)), (int)text->len, text->term);
+        goto done;
+      }
+      nob_da_append(&results, dag_intern(dag, LAMBDA_ATOM, task.depth - binder, TERM_NONE, TERM_NONE));
+    } break;
+    case LAMBDA_ABSTRACTION: {
+      Task abstract = {.kind = DAG_ABSTRACT, .name = split.name, .shadowed = binder_depths.items[split.name]};
+      nob_da_append(&stack, abstract);
+      binder_depths.items[split.name] = task.depth + 1;
+      nob_da_append(&stack, ((Task){.kind = DAG_PARSE, .l = split.l, .r = split.r, .depth = task.depth + 1}));
+    } break;
+    case LAMBDA_APPLICATION: {
+      nob_da_append(&stack, ((Task){.kind = DAG_APPLY}));
+      nob_da_append(&stack,
+                    ((Task){.kind = DAG_PARSE, .l = split.argument_l, .r = split.argument_r, .depth = task.depth}));
+      nob_da_append(&stack, ((Task){.kind = DAG_PARSE, .l = split.l, .r = split.r, .depth = task.depth}));
+    } break;
+    }
+  }
+
+  assert(results.count == 1);
+  *root = results.items[0];
+  ok = true;
+
+done:
+  nob_da_free(stack);
+  nob_da_free(results);
+  nob_da_free(binder_depths);
+  return ok;
+}
+
+bool dag_parse_lambda_term(Term_Dag *dag, String_View term, Dag_Index *root) {
+  Lambda_Text text;
+  if (!lambda_text_init(&text, term.data, term.count)) return false;
+
+  bool ok = dag_parse_lambda_term_impl(dag, &text, root);
+
+  lambda_text_free(&text);
+  return ok;
+}
+
+// Number of nodes of the tree root stands for, shared nodes counted once per occurrence, or SIZE_MAX past `limit`.
+static size_t dag_unshared_size(const Term_Dag *dag, Dag_Index root, size_t limit) {
+  size_t *sizes = calloc(dag->nodes.count, sizeof(size_t)); // 0 until known
+  assert(sizes != NULL && "Out of memory");
+  Vec(Dag_Index) stack = {0};
+
+  nob_da_append(&stack, root);
+  while (stack.count > 0 && sizes[root] == 0) {
+    Dag_Index index = stack.items[stack.count - 1];
+    Term_Node node = dag->nodes.items[index];
+    bool left = node.left == TERM_NONE || sizes[node.left] != 0;
+    bool right = node.right == TERM_NONE || sizes[node.right] != 0;
+    if (!left) nob_da_append(&stack, node.left);
+    if (!right) nob_da_append(&stack, node.right);
+    if (!left || !right) continue;
+
+    stack.count -= 1;
+    // Sizes are at most `limit` or SIZE_MAX, and a Term_Index is 32 bits, so the sums only overflow into SIZE_MAX.
+    size_t size = 1;
+    if (node.left != TERM_NONE) size = sizes[node.left] > limit ? SIZE_MAX : size + sizes[node.left];
+    if (node.right != TERM_NONE && size <= limit) {
+      size = sizes[node.right] > limit ? SIZE_MAX : size + sizes[node.right];
+    }
+    sizes[index] = size > limit ? SIZE_MAX : size;
+  }
+
+  size_t size = sizes[root];
+  free(sizes);
+  nob_da_free(stack);
+  return size;
+}
+
+// Number of distinct nodes reachable from root.
+size_t dag_size(const Term_Dag *dag, Dag_Index root) {
+  bool *seen = calloc(dag->nodes.count, sizeof(bool));
+  assert(seen != NULL && "Out of memory");
+  Vec(Dag_Index) stack = {0};
+  size_t size = 0;
+
+  nob_da_append(&stack, root);
+  while (stack.count > 0) {
+    Dag_Index index = stack.items[--stack.count];
+    if (index == TERM_NONE || seen[index]) continue;
+    seen[index] = true;
+    size += 1;
+    nob_da_append(&stack, dag->nodes.items[index].left);
+    nob_da_append(&stack, dag->nodes.items[index].right);
+  }
+
+  free(seen);
+  nob_da_free(stack);
+  return size;
+}
+
+void dag_free(Term_Dag *dag) {
+  nob_da_free(dag->nodes);
+  nob_da_free(dag->free);
+  nob_da_free(dag->whnf);
+  nob_da_free(dag->normal_form);
+  free(dag->table);
+  *dag = (Term_Dag){0};
+}
+
+/*
+ * Results of shifting and substituting within one contraction, keyed by the node and the two parameters of the
+ * call. Without them a substitution would walk a shared node once per path leading to it, which is exponential in
+ * the sharing. Bumping the stamp empties the map.
+ */
+typedef struct {
+  Dag_Index node;
+  uint32_t a, b;
+  uint32_t stamp;
+  Dag_Index result;
+} Dag_Memo_Entry;
+
+typedef struct {
+  Dag_Memo_Entry *entries;
+  size_t capacity;
+  size_t count; // entries with the current stamp
+  uint32_t stamp;
+} Dag_Memo;
+
+static size_t dag_memo_slot(const Dag_Memo *memo, Dag_Index node, uint32_t a, uint32_t b) {
+  return dag_mix(((uint64_t)node << 32 | a) ^ dag_mix(b)) & (memo->capacity - 1);
+}
+
+static bool dag_memo_get(const Dag_Memo *memo, Dag_Index node, uint32_t a, uint32_t b, Dag_Index *result) {
+  if (memo->capacity == 0) return false;
+  for (size_t i = dag_memo_slot(memo, node, a, b); memo->entries[i].stamp == memo->stamp;
+       i = (i + 1) & (memo->capacity - 1)) {
+    Dag_Memo_Entry entry = memo->entries[i];
+    if (entry.node == node && entry.a == a && entry.b == b) {
+      *result = entry.result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void dag_memo_put(Dag_Memo *memo, Dag_Index node, uint32_t a, uint32_t b, Dag_Index result) {
+  if (2 * (memo->count + 1) > memo->capacity) {
+    Dag_Memo old = *memo;
+    memo->capacity = old.capacity > 0 ? old.capacity * 2 : DAG_INITIAL_CAPACITY;
+    memo->entries = calloc(memo->capacity, sizeof(Dag_Memo_Entry));
+    assert(memo->entries != NULL && "Out of memory");
+    memo->stamp = 1;
+    memo->count = 0;
+    for (size_t i = 0; i < old.capacity; ++i) {
+      Dag_Memo_Entry entry = old.entries[i];
+      if (entry.stamp == old.stamp) dag_memo_put(memo, entry.node, entry.a, entry.b, entry.result);
+    }
+    free(old.entries);
+  }
+
+  size_t i = dag_memo_slot(memo, node, a, b);
+  while (memo->entries[i].stamp == memo->stamp) i = (i + 1) & (memo->capacity - 1);
+  memo->entries[i] = (Dag_Memo_Entry){.node = node, .a = a, .b = b, .stamp = memo->stamp, .result = result};
+  memo->count += 1;
+}
+
+static void dag_memo_clear(Dag_Memo *memo) {
+  memo->stamp += 1;
+  memo->count = 0;
+  if (memo->stamp == 0) {
+    // Wrapped around, old stamps would look current again.
+    memset(memo->entries, 0, memo->capacity * sizeof(Dag_Memo_Entry));
+    memo->stamp = 1;
+  }
+}
+
+/*
+ * Shifts and substitutions walk a term as deep as it is, and so do the weak head and normal form searches, so none
+ * of them recurses: each keeps an explicit stack, and the stacks live here to be reused from one call to the next.
+ */
+typedef enum {
+  DAG_SHIFT, // shift `node` by a, atoms bound at or above b
+  DAG_SUBSTITUTE, // substitute b for the atom bound a abstractions above `node`
+  DAG_SHIFTED, // the children of `node` are on the result stack, rebuild it
+  DAG_SUBSTITUTED,
+} Dag_Task_Kind;
+
+typedef struct {
+  Dag_Task_Kind kind;
+  Dag_Index node;
+  uint32_t a, b; // the memo key, along with the node
+} Dag_Task;
+
+typedef struct {
+  size_t visited; // where the level's run of terms waiting for a weak head normal form starts
+  Dag_Index argument; // of the application whose function the level above is reducing
+} Dag_Spine;
+
+typedef struct {
+  Dag_Index term;
+  Dag_Index whnf;
+  bool expanded;
+} Dag_Frame;
+
+typedef struct {
+  Term_Dag *dag;
+  Dag_Memo shifts; // (node, shift, cutoff)
+  Dag_Memo substitutions; // (node, depth, argument)
+  Vec(Dag_Task) tasks;
+  Vec(Dag_Index) results;
+  Vec(Dag_Spine) spine;
+  Vec(Dag_Index) visited;
+
+  Reduce_Budget budget;
+  Reduce_Stats *stats;
+  double start;
+  bool stopped;
+} Dag_Reducer;
+
+/*
+ * Runs a shift or a substitution to the end. Shifting shifts up the atoms bound at or above the cutoff, substituting
+ * replaces the atom bound `depth` abstractions above with the argument (shifted up by depth) and shifts the atoms
+ * further out down by one. Subterms with nothing to change are returned as they are.
+ */
+static Dag_Index dag_rewrite(Dag_Reducer *reducer, Dag_Task task) {
+  Term_Dag *dag = reducer->dag;
+  reducer->tasks.count = 0;
+  reducer->results.count = 0;
+
+  nob_da_append(&reducer->tasks, task);
+  while (reducer->tasks.count > 0) {
+    task = reducer->tasks.items[--reducer->tasks.count];
+    Term_Node n = dag->nodes.items[task.node];
+    bool shift = task.kind == DAG_SHIFT || task.kind == DAG_SHIFTED;
+    Dag_Memo *memo = shift ? &reducer->shifts : &reducer->substitutions;
+    Dag_Index result;
+
+    if (task.kind == DAG_SHIFTED || task.kind == DAG_SUBSTITUTED) {
+      if (term_kind(n) == LAMBDA_ABSTRACTION) {
+        Dag_Index body = reducer->results.items[--reducer->results.count];
+        result = dag_intern(dag, LAMBDA_ABSTRACTION, term_data(n), TERM_NONE, body);
+      } else {
+        Dag_Index right = reducer->results.items[--reducer->results.count];
+        Dag_Index left = reducer->results.items[--reducer->results.count];
+        result = dag_intern(dag, LAMBDA_APPLICATION, 0, left, right);
+      }
+      dag_memo_put(memo, task.node, task.a, task.b, result);
+      nob_da_append(&reducer->results, result);
+      continue;
+    }
+
+    uint32_t untouched = shift ? task.b : task.a; // free atoms below this are left alone
+    if ((shift && task.a == 0) || dag->free.items[task.node] <= untouched) {
+      nob_da_append(&reducer->results, task.node);
+      continue;
+    }
+    if (dag_memo_get(memo, task.node, task.a, task.b, &result)) {
+      nob_da_append(&reducer->results, result);
+      continue;
+    }
+
+    switch (term_kind(n)) {
+    case LAMBDA_ATOM:
+      if (shift) {
+        result = dag_intern(dag, LAMBDA_ATOM, term_data(n) + task.a, TERM_NONE, TERM_NONE);
+      } else if (term_data(n) == task.a) {
+        // The argument, shifted by the depth; shifts never start a substitution, so it runs right here.
+        nob_da_append(&reducer->tasks, ((Dag_Task){.kind = DAG_SHIFT, .node = task.b, .a = task.a, .b = 0}));
+        continue;
+      } else {
+        result = dag_intern(dag, LAMBDA_ATOM, term_data(n) - 1, TERM_NONE, TERM_NONE);
+      }
+      dag_memo_put(memo, task.node, task.a, task.b, result);
+      nob_da_append(&reducer->results, result);
+      break;
+    case LAMBDA_ABSTRACTION: {
+      Dag_Task body = {.kind = task.kind, .node = n.right, .a = task.a, .b = task.b};
+      if (shift) body.b += 1;
+      else body.a += 1;
+      nob_da_append(&reducer->tasks, ((Dag_Task){.kind = shift ? DAG_SHIFTED : DAG_SUBSTITUTED, .node = task.node,
+                                                 .a = task.a, .b = task.b}));
+      nob_da_append(&reducer->tasks, body);
+    } break;
+    case LAMBDA_APPLICATION:
+      nob_da_append(&reducer->tasks, ((Dag_Task){.kind = shift ? DAG_SHIFTED : DAG_SUBSTITUTED, .node = task.node,
+                                                 .a = task.a, .b = task.b}));
+      nob_da_append(&reducer->tasks, ((Dag_Task){.kind = task.kind, .node = n.right, .a = task.a, .b = task.b}));
+      nob_da_append(&reducer->tasks, ((Dag_Task){.kind = task.kind, .node = n.left, .a = task.a, .b = task.b}));
+      break;
+    }
+  }
+
+  assert(reducer->results.count == 1);
+  return reducer->results.items[0];
+}
+
+// `body` with the atom bound `depth` abstractions above it replaced by `argument`, atoms further out shifted down.
+static Dag_Index dag_substitute(Dag_Reducer *reducer, Dag_Index body, Dag_Index argument, uint32_t depth) {
+  return dag_rewrite(reducer, (Dag_Task){.kind = DAG_SUBSTITUTE, .node = body, .a = depth, .b = argument});
+}
+
+/*
+ * Contracts head redexes until the head is stuck. Getting to the head means bringing the function of every
+ * application on the left spine to a weak head normal form first, one level of the spine per application, and every
+ * term passed through on the way gets the weak head normal form of its level cached.
+ */
+static Dag_Index dag_whnf(Dag_Reducer *reducer, Dag_Index term) {
+  Term_Dag *dag = reducer->dag;
+  reducer->spine.count = 0;
+  reducer->visited.count = 0;
+  size_t visited = 0;
+
+  for (;;) {
+    // Down the spine to a term that is already in weak head normal form.
+    while (dag->whnf.items[term] == TERM_NONE && term_kind(dag->nodes.items[term]) == LAMBDA_APPLICATION) {
+      Term_Node node = dag->nodes.items[term];
+      nob_da_append(&reducer->visited, term);
+      nob_da_append(&reducer->spine, ((Dag_Spine){.visited = visited, .argument = node.right}));
+      visited = reducer->visited.count;
+      term = node.left;
+    }
+    if (dag->whnf.items[term] != TERM_NONE) term = dag->whnf.items[term];
+
+    // Back up, contracting the redexes the weak head normal forms make, until one needs going down again.
+    for (;;) {
+      dag->whnf.items[term] = term;
+      for (size_t i = visited; i < reducer->visited.count; ++i) dag->whnf.items[reducer->visited.items[i]] = term;
+      reducer->visited.count = visited;
+      if (reducer->spine.count == 0) return term;
+
+      Dag_Spine level = reducer->spine.items[--reducer->spine.count];
+      visited = level.visited;
+      Term_Node head = dag->nodes.items[term];
+      if (term_kind(head) != LAMBDA_ABSTRACTION) {
+        term = dag_intern(dag, LAMBDA_APPLICATION, 0, term, level.argument);
+        continue;
+      }
+
+      Reduce_Stats *stats = reducer->stats;
+      if (reduce_budget_exhausted(reducer->budget, stats->steps, dag->nodes.count, reducer->start, &stats->outcome)) {
+        reducer->stopped = true;
+        return term;
+      }
+      dag_memo_clear(&reducer->shifts);
+      dag_memo_clear(&reducer->substitutions);
+      term = dag_substitute(reducer, head.right, level.argument, 0);
+      stats->steps += 1;
+      break;
+    }
+  }
+}
+
+/*
+ * Putting the normal form together takes no steps of its own once the weak head normal forms are cached, and a term
+ * whose weak head normal form contains it under a binder unfolds forever without any. So the budget is checked on
+ * every frame too: the frames on the stack stand for distinct nodes of the unshared normal form, which has to stay
+ * within the node limit (and within what a Term_Store can index when there is none), and so does the DAG.
+ */
+static bool dag_frames_exhausted(Dag_Reducer *reducer, size_t frames, size_t stacked) {
+  Reduce_Budget budget = reducer->budget;
+  Reduce_Stats *stats = reducer->stats;
+  size_t limit = budget.max_nodes != 0 ? budget.max_nodes : DAG_MAX_UNSHARED;
+
+  if (stacked > limit || (budget.max_nodes != 0 && reducer->dag->nodes.count > budget.max_nodes)) {
+    stats->outcome = REDUCE_NODE_LIMIT;
+    reducer->stopped = true;
+  } else if (budget.max_seconds > 0 && frames % REDUCE_CLOCK_INTERVAL == 0 &&
+             now_seconds() - reducer->start > budget.max_seconds) {
+    stats->outcome = REDUCE_TIME_LIMIT;
+    reducer->stopped = true;
+  }
+  return reducer->stopped;
+}
+
+// The normal form: the weak head normal form, then the normal forms of its children, left before right.
+static Dag_Index dag_normal_form(Dag_Reducer *reducer, Dag_Index root) {
+  Term_Dag *dag = reducer->dag;
+  Vec(Dag_Frame) stack = {0};
+  Vec(Dag_Index) results = {0};
+  Dag_Index result = root;
+  size_t frames = 0;
+
+  nob_da_append(&stack, ((Dag_Frame){.term = root}));
+  while (stack.count > 0) {
+    if (dag_frames_exhausted(reducer, ++frames, stack.count + results.count)) {
+      result = root;
+      goto done;
+    }
+    Dag_Frame frame = stack.items[--stack.count];
+    Term_Node node;
+
+    if (!frame.expanded) {
+      result = dag->normal_form.items[frame.term];
+      if (result != TERM_NONE) {
+        nob_da_append(&results, result);
+        continue;
+      }
+
+      frame.whnf = dag_whnf(reducer, frame.term);
+      if (reducer->stopped) {
+        result = root;
+        goto done;
+      }
+
+      result = dag->normal_form.items[frame.whnf];
+      node = dag->nodes.items[frame.whnf];
+      if (result == TERM_NONE && term_kind(node) != LAMBDA_ATOM) {
+        nob_da_append(&stack, ((Dag_Frame){.term = frame.term, .whnf = frame.whnf, .expanded = true}));
+        nob_da_append(&stack, ((Dag_Frame){.term = node.right}));
+        if (term_kind(node) == LAMBDA_APPLICATION) nob_da_append(&stack, ((Dag_Frame){.term = node.left}));
+        continue;
+      }
+      if (result == TERM_NONE) result = frame.whnf;
+    } else {
+      node = dag->nodes.items[frame.whnf];
+      if (term_kind(node) == LAMBDA_ABSTRACTION) {
+        Dag_Index body = results.items[--results.count];
+        result = dag_intern(dag, LAMBDA_ABSTRACTION, term_data(node), TERM_NONE, body);
+      } else {
+        Dag_Index right = results.items[--results.count];
+        Dag_Index left = results.items[--results.count];
+        result = dag_intern(dag, LAMBDA_APPLICATION, 0, left, right);
+      }
+    }
+
+    dag->normal_form.items[result] = result;
+    dag->normal_form.items[frame.whnf] = result;
+    dag->normal_form.items[frame.term] = result;
+    nob_da_append(&results, result);
+  }
+
+  assert(results.count == 1);
+  result = results.items[0];
+
+done:
+  nob_da_free(stack);
+  nob_da_free(results);
+  return result;
+}
+
+bool dag_normalize(Term_Dag *dag, Dag_Index root, Dag_Index *result, Reduce_Budget budget, Reduce_Stats *stats) {
+  Dag_Reducer reducer = {.dag = dag, .budget = budget, .stats = stats, .start = now_seconds()};
+  *stats = (Reduce_Stats){.outcome = REDUCE_NORMAL_FORM};
+
+  *result = dag_normal_form(&reducer, root);
+  stats->nodes = dag_size(dag, *result);
+  stats->peak_nodes = dag->nodes.count;
+  stats->seconds = now_seconds() - reducer.start;
+
+  free(reducer.shifts.entries);
+  free(reducer.substitutions.entries);
+  nob_da_free(reducer.tasks);
+  nob_da_free(reducer.results);
+  nob_da_free(reducer.spine);
+  nob_da_free(reducer.visited);
+  return !reducer.stopped;
+}
+
+bool dag_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats) {
+  Term_Store store = {0};
+  Term_Dag dag = {0};
+  *stats = (Reduce_Stats){.outcome = REDUCE_ERROR};
+  bool ok = false;
+
+  Term_Index root;
+  if (!term_from_tree(&store, *tree, &root)) goto done;
+  Dag_Index result;
+  if (!dag_normalize(&dag, dag_from_term(&dag, &store, root), &result, budget, stats)) {
+    ok = stats->outcome != REDUCE_ERROR;
+    goto done;
+  }
+
+  // The normal form can be exponentially bigger written out than in the DAG.
+  size_t limit = budget.max_nodes != 0 ? budget.max_nodes : DAG_MAX_UNSHARED;
+  if (dag_unshared_size(&dag, result, limit) > limit) {
+    stats->outcome = REDUCE_NODE_LIMIT;
+    ok = true;
+    goto done;
+  }
+
+  store.count = 0;
+  root = dag_to_term(&store, &dag, result);
+  Tree_Node *node = tree_new_node(arena);
+  if (node == NULL || !term_to_tree(arena, node, &store, root)) {
+    stats->outcome = REDUCE_ERROR;
+    goto done;
+  }
+  tree_discard(arena, *tree);
+  *tree = node;
+  ok = true;
+
+done:
+  nob_da_free(store);
+  dag_free(&dag);
+  return ok;
+}
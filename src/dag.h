@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "parser.h"
+#include "reduce.h"
+#include "term.h"
+#include "util.h"
+
+/*
+ * Hash-consed terms.
+ *
+ * A Term_Dag stores every distinct de Bruijn subterm exactly once: nodes are interned by their kind, data and
+ * children, and since the children are interned first, two subterms are equal if and only if they have the same
+ * index (names of bound atoms included). A numeral that occurs a thousand times costs one set of nodes, so the
+ * number of nodes measures what is in a term rather than how long it is written out.
+ *
+ * Nodes have the Term_Node layout, but a shared node has several parents, so subterms are not contiguous and the
+ * range-based Term_Store functions do not apply; dag_from_term and dag_to_term convert between the two.
+ * dag_parse_lambda_term builds the DAG straight from text, without a tree in between.
+ *
+ * dag_normalize reduces in normal order on the DAG itself. A substitution rebuilds only the paths that lead to
+ * the substituted atom and shares everything else, the argument included, so copying a subterm is handing out its
+ * index. The weak head and normal forms of every node are cached, so a subterm that occurs many times (or shows up
+ * again later) is only reduced once. Node counts in the stats are distinct nodes: the size of the DAG, not of the
+ * tree it stands for.
+ */
+
+typedef Term_Index Dag_Index;
+
+typedef struct {
+  Term_Store nodes;
+  Vec(uint32_t) free; // per node, 1 + the largest free de Bruijn index, 0 if closed
+  Vec(Dag_Index) whnf; // per node, its weak head normal form once known, else TERM_NONE
+  Vec(Dag_Index) normal_form; // per node, its normal form once known, else TERM_NONE
+  Dag_Index *table; // open addressing, TERM_NONE for an empty slot
+  size_t capacity; // a power of two, or 0
+} Term_Dag;
+
+Dag_Index dag_intern(Term_Dag *dag, Lambda_Expr_Kind kind, uint32_t data, Dag_Index left, Dag_Index right);
+Dag_Index dag_from_term(Term_Dag *dag, const Term_Store *store, Term_Index root);
+Term_Index dag_to_term(Term_Store *store, const Term_Dag *dag, Dag_Index root);
+bool dag_parse_lambda_term(Term_Dag *dag, String_View term, Dag_Index *root);
+size_t dag_size(const Term_Dag *dag, Dag_Index root);
+void dag_free(Term_Dag *dag);
+
+bool dag_normalize(Term_Dag *dag, Dag_Index root, Dag_Index *result, Reduce_Budget budget, Reduce_Stats *stats);
+bool dag_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats);
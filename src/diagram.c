@@ -1,235 +1,726 @@
 #include "diagram.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <nob.h>
 #include <raylib.h>
 #include <raymath.h>
 
-Tree_Node *get_leftmost_atom_node(Tree_Node *node) {
-  while (node != NULL) {
-    while (node->kind == LAMBDA_ABSTRACTION) {
-      node = node->right;
-    }
+// What laying out a subtree leaves behind for its parent.
+typedef struct {
+  size_t lowest_y; // of the horizontal lines in the subtree, 0 if there are none
+  size_t leftmost_atom; // index of the vertical line of the subtree's leftmost atom
+} Diagram_Subtree;
+
+// An atom draws a vertical line, an abstraction or an application a horizontal one. An abstraction's left child
+// only names its variable.
+static void diagram_count_lines(const Tree_Node *tree, size_t *horizontals, size_t *verticals) {
+  Vec(const Tree_Node *) stack = {0};
+  *horizontals = 0;
+  *verticals = 0;
+
+  nob_da_append(&stack, tree);
+  while (stack.count > 0) {
+    const Tree_Node *node = stack.items[--stack.count];
+    if (node->kind == LAMBDA_ATOM) *verticals += 1;
+    else *horizontals += 1;
+    if (node->kind == LAMBDA_APPLICATION) nob_da_append(&stack, node->left);
+    if (node->kind != LAMBDA_ATOM) nob_da_append(&stack, node->right);
+  }
+
+  nob_da_free(stack);
+}
 
-    if (node->left == NULL) return node;
-    node = node->left;
+// Points the arrays into one block with room for the given number of lines, reusing the diagram's if it is big
+// enough. With keep, the lines already in the diagram move along to a new block.
+static void diagram_reserve(Diagram *diagram, size_t horizontals, size_t verticals, bool keep) {
+  Diagram old = *diagram;
+  if (horizontals > diagram->horizontal_capacity || verticals > diagram->vertical_capacity) {
+    horizontals = max(horizontals, diagram->horizontal_capacity);
+    verticals = max(verticals, diagram->vertical_capacity);
+    diagram->memory = malloc((3 * horizontals + 3 * verticals) * sizeof(uint32_t) + horizontals);
+    assert(diagram->memory != NULL && "Out of memory");
+    diagram->horizontal_capacity = horizontals;
+    diagram->vertical_capacity = verticals;
   }
 
-  return NULL;
+  uint32_t *coordinates = diagram->memory;
+  horizontals = diagram->horizontal_capacity;
+  verticals = diagram->vertical_capacity;
+  diagram->horizontal = (Diagram_Horizontals){
+      .x0 = coordinates,
+      .x1 = coordinates + horizontals,
+      .y = coordinates + 2 * horizontals,
+      .kind = (uint8_t *)(coordinates + 3 * horizontals + 3 * verticals),
+      .count = old.horizontal.count,
+  };
+  diagram->vertical = (Diagram_Verticals){
+      .x = coordinates + 3 * horizontals,
+      .y0 = coordinates + 3 * horizontals + verticals,
+      .y1 = coordinates + 3 * horizontals + 2 * verticals,
+      .count = old.vertical.count,
+  };
+  if (diagram->memory == old.memory) return;
+
+  if (keep && old.memory != NULL) {
+    size_t h = old.horizontal.count, v = old.vertical.count;
+    memcpy(diagram->horizontal.x0, old.horizontal.x0, h * sizeof(uint32_t));
+    memcpy(diagram->horizontal.x1, old.horizontal.x1, h * sizeof(uint32_t));
+    memcpy(diagram->horizontal.y, old.horizontal.y, h * sizeof(uint32_t));
+    memcpy(diagram->horizontal.kind, old.horizontal.kind, h);
+    memcpy(diagram->vertical.x, old.vertical.x, v * sizeof(uint32_t));
+    memcpy(diagram->vertical.y0, old.vertical.y0, v * sizeof(uint32_t));
+    memcpy(diagram->vertical.y1, old.vertical.y1, v * sizeof(uint32_t));
+  }
+  free(old.memory);
+}
+
+// Index of a slot for a new line, a free one if there is any. Only diagram_relayout ever has to grow the arrays.
+static size_t diagram_new_horizontal(Diagram *diagram) {
+  if (diagram->free_horizontal.count > 0) return diagram->free_horizontal.items[--diagram->free_horizontal.count];
+  if (diagram->horizontal.count == diagram->horizontal_capacity) {
+    diagram_reserve(diagram, 2 * diagram->horizontal_capacity + 16, diagram->vertical_capacity, true);
+  }
+  return diagram->horizontal.count++;
+}
+
+static size_t diagram_new_vertical(Diagram *diagram) {
+  if (diagram->free_vertical.count > 0) return diagram->free_vertical.items[--diagram->free_vertical.count];
+  if (diagram->vertical.count == diagram->vertical_capacity) {
+    diagram_reserve(diagram, diagram->horizontal_capacity, 2 * diagram->vertical_capacity + 16, true);
+  }
+  return diagram->vertical.count++;
 }
 
-void diagram_from_lambda_tree_impl(Diagram *diagram, Tree_Node *node, size_t *breadth, size_t *depth);
+// The lines are counted first, so the diagram is sized once up front and lines are filled in by index, which each
+// node keeps in its user_data (into the horizontal or the vertical lines). The diagram's earlier contents are
+// replaced and its memory only grows when a bigger tree comes along.
+Diagram_Subtree diagram_from_lambda_tree_impl(Diagram *diagram, Tree_Node *node, size_t *breadth, size_t *depth);
 void diagram_from_lambda_tree(Diagram *diagram, Tree_Node *tree) {
+  size_t horizontals, verticals;
+  diagram_count_lines(tree, &horizontals, &verticals);
+  assert(horizontals + verticals < UINT32_MAX && "Coordinates are 32 bits");
+  diagram->horizontal.count = 0;
+  diagram->vertical.count = 0;
+  diagram->free_horizontal.count = 0;
+  diagram->free_vertical.count = 0;
+  diagram_reserve(diagram, horizontals, verticals, false);
+  diagram->width = 0;
+  diagram->height = 0;
+
   size_t breadth = 0, depth = 0;
-  diagram_from_lambda_tree_impl(diagram, tree, &breadth, &depth);
-  Tree_Node *main_node = get_leftmost_atom_node(tree);
-  assert(main_node != NULL && "Well-formed lambda tree should have leftmost atom node");
-  assert(main_node->user_data != NULL && "Node in complete diagram should have a corresponding line");
-
-  size_t lowest_line_y = 0;
-  for (size_t i = 0; i < diagram->count; ++i) {
-    Line *line = &diagram->items[i];
-    if (line->orientation == LINE_HORIZONTAL) {
-      if (line->start.y > lowest_line_y) {
-        lowest_line_y = line->start.y;
-      }
+  Diagram_Subtree root = diagram_from_lambda_tree_impl(diagram, tree, &breadth, &depth);
+  diagram->vertical.y1[root.leftmost_atom] = root.lowest_y + 1;
+  diagram->height = max(diagram->height, root.lowest_y + 1);
+  assert(diagram->horizontal.count == horizontals && diagram->vertical.count == verticals);
+}
+
+// Index of the vertical line of the leftmost atom under `node`.
+static size_t diagram_leftmost_atom(const Tree_Node *node) {
+  while (node->kind != LAMBDA_ATOM) node = node->kind == LAMBDA_ABSTRACTION ? node->right : node->left;
+  return (size_t)node->user_data;
+}
+
+// The lowest horizontal line under `node` (see Diagram_Subtree): the innermost of the abstractions on top of it, or
+// the application below them, which is below all the rest.
+static size_t diagram_lowest_y(const Diagram *diagram, const Tree_Node *node) {
+  size_t lowest_y = 0;
+  while (node->kind == LAMBDA_ABSTRACTION) {
+    lowest_y = diagram->horizontal.y[(size_t)node->user_data];
+    node = node->right;
+  }
+  if (node->kind == LAMBDA_APPLICATION) lowest_y = max(lowest_y, diagram->horizontal.y[(size_t)node->user_data]);
+  return lowest_y;
+}
+
+/*
+ * Updates the diagram of `tree` after a beta step replaced the redex `contracted` with `contractum` (see
+ * Reducer.contracted). The diagram has to be the one of the tree before the step, with `contracted` still holding
+ * its line index.
+ *
+ * The redex's lines are the ones starting at or right of its leftmost atom, ending left of the atom that follows
+ * it, and not above its depth; every other line starting right of it is shifted by the change in the number of
+ * atoms. The contractum is then laid out in the freed slots, where the redex was. That leaves the applications
+ * above it, whose y depends on the lowest line of each child: they are walked up from the contractum and moved,
+ * stopping at the first one that stays put. So a step costs one pass over the coordinates plus the size of the
+ * contractum and of the path above it, never a walk over the whole tree.
+ *
+ * Without a contractum (the reducer collected the tree) or once free slots outnumber lines, the diagram is laid
+ * out from scratch instead.
+ */
+void diagram_relayout(Diagram *diagram, Tree_Node *tree, Tree_Node *contracted, Tree_Node *contractum) {
+  if (contracted == NULL || contractum == NULL || diagram->memory == NULL) {
+    diagram_from_lambda_tree(diagram, tree);
+    return;
+  }
+
+  Diagram_Horizontals *horizontal = &diagram->horizontal;
+  Diagram_Verticals *vertical = &diagram->vertical;
+
+  // The redex's atoms ran from begin up to end, under depth abstractions.
+  size_t begin = horizontal->x0[(size_t)contracted->user_data];
+  size_t end = vertical->count - diagram->free_vertical.count;
+  size_t depth = 0;
+  bool end_found = false;
+  for (Tree_Node *child = contractum, *parent = contractum->parent; parent != NULL;
+       child = parent, parent = parent->parent) {
+    if (parent->kind == LAMBDA_ABSTRACTION) {
+      depth += 1;
+    } else if (child == parent->left && !end_found) {
+      end = vertical->x[diagram_leftmost_atom(parent->right)];
+      end_found = true;
+    }
+  }
+
+  size_t horizontals, verticals;
+  diagram_count_lines(contractum, &horizontals, &verticals);
+  uint32_t shift = (uint32_t)(begin + verticals) - (uint32_t)end; // wraps around when the term shrinks
+
+  // The arrays are read through locals, which the compiler cannot otherwise tell apart from diagram->width.
+  uint32_t *x0 = horizontal->x0, *x1 = horizontal->x1, *y = horizontal->y, *x = vertical->x;
+  uint32_t width = 0;
+  for (size_t i = 0; i < horizontal->count; ++i) {
+    if (x0[i] == DIAGRAM_NO_LINE) continue;
+    if (x0[i] >= begin && x1[i] < end && y[i] >= depth) {
+      x0[i] = DIAGRAM_NO_LINE;
+      nob_da_append(&diagram->free_horizontal, i);
+      continue;
     }
+    // Only the abstractions around the redex end on its last atom.
+    if (x0[i] >= end) x0[i] += shift;
+    if (x1[i] >= end - 1) x1[i] += shift;
+    width = max(width, x1[i]);
+  }
+  for (size_t i = 0; i < vertical->count; ++i) {
+    if (x[i] == DIAGRAM_NO_LINE) continue;
+    if (x[i] >= begin && x[i] < end) {
+      x[i] = DIAGRAM_NO_LINE;
+      nob_da_append(&diagram->free_vertical, i);
+    } else if (x[i] >= end) {
+      x[i] += shift;
+    }
+  }
+  diagram->width = width;
+
+  size_t breadth = begin, contractum_depth = depth;
+  Diagram_Subtree subtree = diagram_from_lambda_tree_impl(diagram, contractum, &breadth, &contractum_depth);
+
+  // Walk up, with lowest_y that of `child`. Until the contractum turns out to be the right child of some
+  // application, its leftmost atom has no end yet.
+  size_t lowest_y = subtree.lowest_y;
+  bool leftmost_open = true;
+  Tree_Node *child = contractum;
+  for (Tree_Node *parent = contractum->parent; parent != NULL; child = parent, parent = parent->parent) {
+    if (parent->kind == LAMBDA_ABSTRACTION) {
+      depth -= 1;
+      lowest_y = max(lowest_y, depth);
+      continue;
+    }
+
+    bool from_left = child == parent->left;
+    size_t y = max(lowest_y, diagram_lowest_y(diagram, from_left ? parent->right : parent->left));
+    if (depth > 0) y = max(y, depth - 1);
+    y += 1;
+
+    size_t line = (size_t)parent->user_data;
+    bool moved = horizontal->y[line] != y;
+    horizontal->y[line] = y;
+    if (from_left) {
+      if (moved) vertical->y1[diagram_leftmost_atom(parent->right)] = y;
+    } else if (moved || leftmost_open) {
+      vertical->y1[leftmost_open ? subtree.leftmost_atom : diagram_leftmost_atom(child)] = y;
+      leftmost_open = false;
+    }
+    lowest_y = y;
+
+    if (!moved && !leftmost_open) goto done;
+  }
+
+  // The path reached the root, whose leftmost atom ends below everything.
+  vertical->y1[diagram_leftmost_atom(tree)] = lowest_y + 1;
+  diagram->height = lowest_y + 1;
+
+done:
+  if (diagram->free_horizontal.count + diagram->free_vertical.count > diagram_line_count(*diagram)) {
+    diagram_from_lambda_tree(diagram, tree);
   }
-  Line *main_line = main_node->user_data;
-  main_line->end.y = lowest_line_y + 1;
+}
+
+void diagram_free(Diagram *diagram) {
+  free(diagram->memory);
+  nob_da_free(diagram->free_horizontal);
+  nob_da_free(diagram->free_vertical);
+  *diagram = (Diagram){0};
 }
 
 /*
  * This is a rough description of what the following algorithm does.
  *
  * We keep track of the current breadth and depth of the diagram (i.e. width and height, but in this coordinate
- * system +\infty is down). Then, we recursively go through the lambda tree and add lines to the diagram as
- * follows:
+ * system +\infty is down). Then, we go through the lambda tree depth first (with an explicit stack, so deep terms
+ * cannot overflow the C stack) and add lines to the diagram as follows:
  * - LAMBDA_ATOM:
  *       Add a vertical line from the variable's binder down to \infty (other endpoint will be set when the
  *       application line is added) and increase breadth by one (move to the left).
  * - LAMBDA_ABSTRACTION:
- *       Add a horizontal line at the current depth value and increment depth by one then recurse on the bound
- *       expression (right child)
+ *       Add a horizontal line at the current depth value and increment depth by one then descend into the bound
+ *       expression (right child). Once it is done, decrement depth and end the line at the current breadth.
  * - LAMBDA_APPLICATION:
- *       This one is the most convoluted. We first recurse on both children (importantly, first the left then the
- *       right). This sets up all of the atom vertical lines. Then, we find the leftmost node in each subtree of
- *       this node's children. We then get the corresponding vertical lines and connect them via a horizontal line.
+ *       This one is the most convoluted. We first descend into both children (importantly, first the left then the
+ *       right). This sets up all of the atom vertical lines. Then, we take the leftmost atom of each child and
+ *       connect their vertical lines with a horizontal line, just below every horizontal line that spans the
+ *       application. Those are the lines of the application's own subtree, all of which start at or right of its
+ *       leftmost atom, and the lines of the abstractions it is in, which are still open and span everything that
+ *       is laid out until they close. Every line before the application ends left of it, so it never matters.
  *
- *       FIXME: We compute the depth of the horizontal line by linearly searching through the array.
+ *       So each subtree hands its parent the lowest of its horizontal lines along with its leftmost atom (see
+ *       Diagram_Subtree), and the application line goes one below the lowest of its children's lines and of the
+ *       innermost enclosing abstraction, without looking at any other line.
  *
  *       We then set the other endpoint of the bound variables and add the horizontal application line to the
  *       diagram.
  *
  * There are probably more elegant ways to do this.
  */
-void diagram_from_lambda_tree_impl(Diagram *diagram, Tree_Node *node, size_t *breadth, size_t *depth) {
-  switch (node->kind) {
-  case LAMBDA_ATOM: {
-    assert(node != NULL);
-    assert(node->binder != NULL);
-    Line *binder_line = node->binder->user_data;
-    Line line = {
-        .start = {*breadth, binder_line->start.y},
-        .end = {*breadth, 1000},
-        .orientation = LINE_VERTICAL,
-        .kind = LAMBDA_ATOM,
-    };
-
-    *breadth += 1;
-
-    nob_da_append(diagram, line);
-    node->user_data = &diagram->items[diagram->count - 1];
-  } break;
-  case LAMBDA_ABSTRACTION: {
-    Line line_ = {
-        .start = {*breadth, *depth},
-        .end = {1000, *depth},
-        .orientation = LINE_HORIZONTAL,
-        .kind = LAMBDA_ABSTRACTION,
-    };
-
-    nob_da_append(diagram, line_);
-    node->user_data = &diagram->items[diagram->count - 1];
-    Line *line = node->user_data;
-
-    *depth += 1;
-    diagram_from_lambda_tree_impl(diagram, node->right, breadth, depth);
-    *depth -= 1;
-
-    line->end.x = *breadth - 1;
-  } break;
-  case LAMBDA_APPLICATION: {
-    diagram_from_lambda_tree_impl(diagram, node->left, breadth, depth);
-    diagram_from_lambda_tree_impl(diagram, node->right, breadth, depth);
-
-    Tree_Node *left_tree = get_leftmost_atom_node(node->left);
-    Tree_Node *right_tree = get_leftmost_atom_node(node->right);
-    assert(left_tree != NULL && right_tree != NULL &&
-           "Subtree of well-formed lambda tree should have leftmost atom node");
-
-    Line *left = left_tree->user_data;
-    Line *right = right_tree->user_data;
-    assert(left != NULL && right != NULL &&
-           "Lines corresponding to these lambda atoms should have been set by now.");
-
-    /* Compute the y coordinate of the lowest line currently in the diagram. This is not the most efficient
-     * approach, but it is the simplest; it could (should) be optimized at some point. */
-    size_t lowest_line_y = 0;
-    for (size_t i = 0; i < diagram->count; ++i) {
-      Line *line = &diagram->items[i];
-      if (line->orientation == LINE_HORIZONTAL) {
-        if (line->start.y > lowest_line_y && line->end.x >= left->start.x) {
-          lowest_line_y = line->start.y;
-        }
+Diagram_Subtree diagram_from_lambda_tree_impl(Diagram *diagram, Tree_Node *node, size_t *breadth, size_t *depth) {
+  typedef struct {
+    Tree_Node *node;
+    bool expanded; // the children have been laid out
+    size_t line; // index of the abstraction's horizontal line, if expanded
+  } Frame;
+
+  Diagram_Horizontals *horizontal = &diagram->horizontal;
+  Diagram_Verticals *vertical = &diagram->vertical;
+  Vec(Frame) stack = {0};
+  Vec(Diagram_Subtree) done = {0}; // laid out subtrees whose parent is not done yet, the rightmost on top
+  nob_da_append(&stack, ((Frame){.node = node}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    node = frame.node;
+
+    switch (node->kind) {
+    case LAMBDA_ATOM: {
+      assert(node != NULL);
+      assert(node->binder != NULL);
+      size_t line = diagram_new_vertical(diagram);
+      vertical->x[line] = *breadth;
+      vertical->y0[line] = horizontal->y[(size_t)node->binder->user_data];
+      vertical->y1[line] = 1000;
+
+      *breadth += 1;
+
+      node->user_data = (void *)line;
+      nob_da_append(&done, ((Diagram_Subtree){.lowest_y = 0, .leftmost_atom = line}));
+    } break;
+    case LAMBDA_ABSTRACTION: {
+      if (frame.expanded) {
+        *depth -= 1;
+        horizontal->x1[frame.line] = *breadth - 1;
+        diagram->width = max(diagram->width, *breadth - 1);
+        Diagram_Subtree *body = &done.items[done.count - 1];
+        body->lowest_y = max(body->lowest_y, *depth);
+        break;
+      }
+
+      size_t line = diagram_new_horizontal(diagram);
+      horizontal->x0[line] = *breadth;
+      horizontal->x1[line] = 1000;
+      horizontal->y[line] = *depth;
+      horizontal->kind[line] = LAMBDA_ABSTRACTION;
+
+      node->user_data = (void *)line;
+
+      *depth += 1;
+      nob_da_append(&stack, ((Frame){.node = node, .expanded = true, .line = line}));
+      nob_da_append(&stack, ((Frame){.node = node->right}));
+    } break;
+    case LAMBDA_APPLICATION: {
+      if (!frame.expanded) {
+        nob_da_append(&stack, ((Frame){.node = node, .expanded = true}));
+        nob_da_append(&stack, ((Frame){.node = node->right}));
+        nob_da_append(&stack, ((Frame){.node = node->left}));
+        break;
       }
+
+      assert(done.count >= 2 && "Both children of the application should have been laid out by now");
+      Diagram_Subtree right_tree = done.items[--done.count];
+      Diagram_Subtree *left_tree = &done.items[done.count - 1];
+      size_t left = left_tree->leftmost_atom;
+      size_t right = right_tree.leftmost_atom;
+
+      size_t lowest_line_y = max(left_tree->lowest_y, right_tree.lowest_y);
+      if (*depth > 0) lowest_line_y = max(lowest_line_y, *depth - 1);
+
+      vertical->y1[right] = lowest_line_y + 1;
+      diagram->height = max(diagram->height, lowest_line_y + 1);
+
+      size_t line = diagram_new_horizontal(diagram);
+      horizontal->x0[line] = vertical->x[left];
+      horizontal->x1[line] = vertical->x[right];
+      horizontal->y[line] = lowest_line_y + 1;
+      horizontal->kind[line] = LAMBDA_APPLICATION;
+      diagram->width = max(diagram->width, vertical->x[right]);
+      node->user_data = (void *)line;
+
+      // The application stands in for its left child, whose leftmost atom is its own.
+      left_tree->lowest_y = lowest_line_y + 1;
+    } break;
     }
+  }
+
+  assert(done.count == 1);
+  Diagram_Subtree result = done.items[0];
+  nob_da_free(done);
+  nob_da_free(stack);
+  return result;
+}
 
-    right->end.y = lowest_line_y + 1;
+// Appends src's lines from the given ones on, moved by (dx, dy), to dst. The offsets wrap around like any other
+// uint32_t, so they can move lines up and left as well.
+static void diagram_append_lines(Diagram *dst, const Diagram *src, size_t first_horizontal, size_t horizontals,
+                                 size_t first_vertical, size_t verticals, uint32_t dx, uint32_t dy) {
+  size_t h = dst->horizontal.count, v = dst->vertical.count;
+  if (h + horizontals > dst->horizontal_capacity || v + verticals > dst->vertical_capacity) {
+    diagram_reserve(dst, max(h + horizontals, 2 * dst->horizontal_capacity),
+                    max(v + verticals, 2 * dst->vertical_capacity), true);
+  }
 
-    Line line = {
-        .start = {left->start.x, lowest_line_y + 1},
-        .end = right->end,
-        .orientation = LINE_HORIZONTAL,
-        .kind = LAMBDA_APPLICATION,
-    };
-    nob_da_append(diagram, line);
-    node->user_data = &diagram->items[diagram->count - 1];
-  } break;
+  for (size_t i = 0; i < horizontals; ++i) {
+    dst->horizontal.x0[h + i] = src->horizontal.x0[first_horizontal + i] + dx;
+    dst->horizontal.x1[h + i] = src->horizontal.x1[first_horizontal + i] + dx;
+    dst->horizontal.y[h + i] = src->horizontal.y[first_horizontal + i] + dy;
+    dst->horizontal.kind[h + i] = src->horizontal.kind[first_horizontal + i];
+  }
+  for (size_t i = 0; i < verticals; ++i) {
+    dst->vertical.x[v + i] = src->vertical.x[first_vertical + i] + dx;
+    dst->vertical.y0[v + i] = src->vertical.y0[first_vertical + i] + dy;
+    dst->vertical.y1[v + i] = src->vertical.y1[first_vertical + i] + dy;
   }
+  dst->horizontal.count += horizontals;
+  dst->vertical.count += verticals;
 }
 
-void diagram_to_raylib_texture(RenderTexture2D texture, Diagram diagram, size_t line_width, double serif_multiplier) {
-  size_t width = texture.texture.width;
-  size_t height = texture.texture.height;
-  size_t diagram_width = 0, diagram_height = 0;
-  for (size_t i = 0; i < diagram.count; ++i) {
-    if (diagram.items[i].orientation == LINE_HORIZONTAL) {
-      diagram_width = max(diagram_width, diagram.items[i].end.x);
-    }
+static uint64_t diagram_mix(uint64_t hash) {
+  // splitmix64 finalizer
+  hash ^= hash >> 30;
+  hash *= UINT64_C(0xbf58476d1ce4e5b9);
+  hash ^= hash >> 27;
+  hash *= UINT64_C(0x94d049bb133111eb);
+  return hash ^ (hash >> 31);
+}
+
+// Only atoms carry data that counts (their de Bruijn index), the names abstractions keep do not.
+static uint64_t diagram_subterm_hash(Term_Node node, uint64_t left, uint64_t right) {
+  uint64_t token = term_kind(node) == LAMBDA_ATOM ? node.head : term_kind(node);
+  return diagram_mix((token << 32 ^ left) + diagram_mix(right));
+}
 
-    if (diagram.items[i].orientation == LINE_VERTICAL) {
-      diagram_height = max(diagram_height, diagram.items[i].end.y);
+static uint64_t diagram_memo_slot_hash(uint64_t hash) {
+  return hash != 0 ? hash : 1;
+}
+
+static Diagram_Memo_Entry *diagram_memo_find(const Diagram_Memo *memo, const Term_Store *store, Term_Index root,
+                                             uint64_t hash) {
+  hash = diagram_memo_slot_hash(hash);
+  if (memo->capacity == 0) return NULL;
+
+  for (size_t i = hash & (memo->capacity - 1); memo->entries[i].hash != 0; i = (i + 1) & (memo->capacity - 1)) {
+    Diagram_Memo_Entry *entry = &memo->entries[i];
+    if (entry->hash != hash) continue;
+    if (entry->key == TERM_NONE || term_equal(&memo->terms, entry->key, store, root)) return entry;
+  }
+  return NULL;
+}
+
+static void diagram_memo_place(Diagram_Memo_Entry *entries, size_t capacity, Diagram_Memo_Entry entry) {
+  size_t i = entry.hash & (capacity - 1);
+  while (entries[i].hash != 0) i = (i + 1) & (capacity - 1);
+  entries[i] = entry;
+}
+
+static void diagram_memo_add(Diagram_Memo *memo, Diagram_Memo_Entry entry) {
+  if (2 * (memo->count + 1) > memo->capacity) {
+    size_t capacity = memo->capacity > 0 ? memo->capacity * 2 : 64;
+    Diagram_Memo_Entry *entries = calloc(capacity, sizeof(Diagram_Memo_Entry));
+    assert(entries != NULL && "Out of memory");
+    for (size_t i = 0; i < memo->capacity; ++i) {
+      if (memo->entries[i].hash != 0) diagram_memo_place(entries, capacity, memo->entries[i]);
     }
+    free(memo->entries);
+    memo->entries = entries;
+    memo->capacity = capacity;
   }
+  entry.hash = diagram_memo_slot_hash(entry.hash);
+  diagram_memo_place(memo->entries, memo->capacity, entry);
+  memo->count += 1;
+}
 
-  const Vector2 scale = {
-      .x = roundf((float)width / (diagram_width + 1)),
-      .y = roundf((float)height / (diagram_height + 1)),
+// Keeps the lines `root` was just laid out with, from the given ones on, relative to its leftmost atom and depth, in
+// the slot it got when it was first seen.
+static void diagram_memo_insert(Diagram_Memo *memo, const Term_Store *store, Term_Index root, uint64_t hash,
+                                const Diagram *diagram, size_t first_horizontal, size_t first_vertical,
+                                size_t breadth, size_t depth, size_t lowest_y) {
+  Diagram_Memo_Entry entry = {
+      .hash = hash,
+      .key = term_copy(&memo->terms, store, root),
+      .first_horizontal = memo->lines.horizontal.count,
+      .first_vertical = memo->lines.vertical.count,
+      .horizontals = diagram->horizontal.count - first_horizontal,
+      .verticals = diagram->vertical.count - first_vertical,
+      .lowest_y = lowest_y - depth,
   };
+  diagram_append_lines(&memo->lines, diagram, first_horizontal, entry.horizontals, first_vertical, entry.verticals,
+                       -(uint32_t)breadth, -(uint32_t)depth);
 
-  BeginTextureMode(texture);
-  ClearBackground(BLACK);
-
-  for (size_t i = 0; i < diagram.count; ++i) {
-    Line *line = &diagram.items[i];
+  const Diagram_Horizontals *lines = &memo->lines.horizontal;
+  for (size_t i = entry.first_horizontal; i < lines->count; ++i) {
+    entry.width = max(entry.width, lines->x1[i]);
+    if (lines->kind[i] == LAMBDA_APPLICATION) entry.height = max(entry.height, lines->y[i]);
+  }
 
-    Vector2 start = {.x = line->start.x, .y = diagram_height - line->start.y};
-    Vector2 end = {.x = line->end.x, .y = diagram_height - line->end.y};
+  Diagram_Memo_Entry *slot = diagram_memo_find(memo, store, root, hash);
+  assert(slot != NULL && slot->key == TERM_NONE);
+  entry.hash = slot->hash;
+  *slot = entry;
+}
 
-    start = Vector2Multiply(start, scale);
-    end = Vector2Multiply(end, scale);
+void diagram_memo_free(Diagram_Memo *memo) {
+  nob_da_free(memo->terms);
+  diagram_free(&memo->lines);
+  nob_da_free(memo->nodes);
+  free(memo->entries);
+  *memo = (Diagram_Memo){0};
+}
 
-    if (line->kind == LAMBDA_ABSTRACTION) {
-      start.x -= serif_multiplier * line_width;
-      end.x += serif_multiplier * line_width;
+/*
+ * The layout of diagram_from_lambda_tree, read off a Term_Store instead of a tree. Atoms find their binder's line
+ * from their de Bruijn index, since the abstraction n levels out is at depth - 1 - n. There are no nodes to keep the
+ * line indices in, so the result cannot be handed to diagram_relayout.
+ *
+ * With a memo, every closed subterm of at least DIAGRAM_MEMO_MIN_NODES nodes is looked up first, and a hit stamps
+ * the entry's lines where the subterm goes. Otherwise it is laid out, and the second time a subterm is seen its lines
+ * go into the memo once it is done (they are the ones added in between, since a subterm is laid out in one go). The
+ * first time only its hash is kept, so that a subterm that occurs once, like the whole term, is never copied: when
+ * closed subterms nest, copying each of them would cost the size of the term times the depth of the nesting.
+ */
+void diagram_from_term(Diagram *diagram, const Term_Store *store, Term_Index root, Diagram_Memo *memo) {
+  typedef struct {
+    Term_Index node;
+    bool expanded; // the children have been laid out
+    bool memorize; // a closed subterm missing from the memo, to be added once it is done
+    size_t line; // index of the abstraction's horizontal line, if expanded
+    size_t first_horizontal, first_vertical, breadth; // where a subterm to memorize started
+  } Frame;
+
+  Term_Index start = term_subterm_start(store, root);
+  size_t count = root - start + 1;
+  size_t verticals = 0;
+  for (Term_Index i = start; i <= root; ++i) verticals += term_kind(store->items[i]) == LAMBDA_ATOM;
+  assert(count < UINT32_MAX && "Coordinates are 32 bits");
+
+  diagram->horizontal.count = 0;
+  diagram->vertical.count = 0;
+  diagram->free_horizontal.count = 0;
+  diagram->free_vertical.count = 0;
+  diagram_reserve(diagram, count - verticals, verticals, false);
+  diagram->width = 0;
+  diagram->height = 0;
+
+  // Children come before their parent, so every node's Diagram_Memo_Node is found in one pass.
+  Diagram_Memo_Node *nodes = NULL;
+  if (memo != NULL) {
+    memo->nodes.count = 0;
+    nob_da_reserve(&memo->nodes, count);
+    nodes = memo->nodes.items;
+    for (size_t i = 0; i < count; ++i) {
+      Term_Node node = store->items[start + i];
+      switch (term_kind(node)) {
+      case LAMBDA_ATOM:
+        nodes[i] = (Diagram_Memo_Node){
+            .hash = diagram_subterm_hash(node, 0, 0),
+            .free_index = term_data(node) + 1,
+            .size = 1,
+        };
+        break;
+      case LAMBDA_ABSTRACTION: {
+        Diagram_Memo_Node body = nodes[node.right - start];
+        nodes[i] = (Diagram_Memo_Node){
+            .hash = diagram_subterm_hash(node, 0, body.hash),
+            .free_index = body.free_index > 0 ? body.free_index - 1 : 0,
+            .size = body.size + 1,
+        };
+      } break;
+      case LAMBDA_APPLICATION: {
+        Diagram_Memo_Node left = nodes[node.left - start], right = nodes[node.right - start];
+        nodes[i] = (Diagram_Memo_Node){
+            .hash = diagram_subterm_hash(node, left.hash, right.hash),
+            .free_index = max(left.free_index, right.free_index),
+            .size = left.size + right.size + 1,
+        };
+      } break;
+      }
     }
+  }
 
-    if (line->orientation == LINE_VERTICAL) {
-      end.y -= 0.5 * line_width;
+  Diagram_Horizontals *horizontal = &diagram->horizontal;
+  Diagram_Verticals *vertical = &diagram->vertical;
+  size_t breadth = 0, depth = 0;
+  Vec(Frame) stack = {0};
+  Vec(Diagram_Subtree) done = {0}; // laid out subtrees whose parent is not done yet, the rightmost on top
+  nob_da_append(&stack, ((Frame){.node = root}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    Term_Node node = store->items[frame.node];
+    size_t i = frame.node - start;
+
+    if (memo != NULL && !frame.expanded && nodes[i].free_index == 0 && nodes[i].size >= DIAGRAM_MEMO_MIN_NODES) {
+      Diagram_Memo_Entry *entry = diagram_memo_find(memo, store, frame.node, nodes[i].hash);
+      if (entry != NULL && entry->key != TERM_NONE) {
+        memo->hits += 1;
+        size_t leftmost_atom = vertical->count;
+        diagram_append_lines(diagram, &memo->lines, entry->first_horizontal, entry->horizontals,
+                             entry->first_vertical, entry->verticals, breadth, depth);
+        vertical->y1[leftmost_atom] = 1000;
+        diagram->width = max(diagram->width, breadth + entry->width);
+        if (entry->height > 0) diagram->height = max(diagram->height, depth + entry->height);
+        breadth += entry->verticals;
+        nob_da_append(&done, ((Diagram_Subtree){.lowest_y = depth + entry->lowest_y, .leftmost_atom = leftmost_atom}));
+        continue;
+      }
+      memo->misses += 1;
+      if (entry == NULL) {
+        diagram_memo_add(memo, (Diagram_Memo_Entry){.hash = nodes[i].hash, .key = TERM_NONE});
+      } else {
+        frame.memorize = true;
+        frame.first_horizontal = horizontal->count;
+        frame.first_vertical = vertical->count;
+        frame.breadth = breadth;
+      }
     }
 
-    start = Vector2Add(start, (Vector2){3.0 * line_width, 0.0});
-    end = Vector2Add(end, (Vector2){3.0 * line_width, 0.0});
+    bool finished = false; // an abstraction or an application is done
+    switch (term_kind(node)) {
+    case LAMBDA_ATOM: {
+      size_t line = vertical->count++;
+      vertical->x[line] = breadth;
+      vertical->y0[line] = depth - 1 - term_data(node);
+      vertical->y1[line] = 1000;
+      breadth += 1;
+      nob_da_append(&done, ((Diagram_Subtree){.lowest_y = 0, .leftmost_atom = line}));
+    } break;
+    case LAMBDA_ABSTRACTION: {
+      if (frame.expanded) {
+        depth -= 1;
+        horizontal->x1[frame.line] = breadth - 1;
+        diagram->width = max(diagram->width, breadth - 1);
+        Diagram_Subtree *body = &done.items[done.count - 1];
+        body->lowest_y = max(body->lowest_y, depth);
+        finished = true;
+        break;
+      }
 
-    DrawLineEx(start, end, line_width, WHITE);
-  }
-  EndTextureMode();
-}
+      size_t line = horizontal->count++;
+      horizontal->x0[line] = breadth;
+      horizontal->x1[line] = 1000;
+      horizontal->y[line] = depth;
+      horizontal->kind[line] = LAMBDA_ABSTRACTION;
+
+      depth += 1;
+      frame.expanded = true;
+      frame.line = line;
+      nob_da_append(&stack, frame);
+      nob_da_append(&stack, ((Frame){.node = node.right}));
+    } break;
+    case LAMBDA_APPLICATION: {
+      if (!frame.expanded) {
+        frame.expanded = true;
+        nob_da_append(&stack, frame);
+        nob_da_append(&stack, ((Frame){.node = node.right}));
+        nob_da_append(&stack, ((Frame){.node = node.left}));
+        break;
+      }
 
-void diagram_to_raylib_window(Diagram diagram, size_t line_width, double serif_multiplier) {
-  size_t width = GetRenderWidth();
-  size_t height = GetRenderHeight();
-  size_t diagram_width = 0, diagram_height = 0;
-  for (size_t i = 0; i < diagram.count; ++i) {
-    if (diagram.items[i].orientation == LINE_HORIZONTAL) {
-      diagram_width = max(diagram_width, diagram.items[i].end.x);
+      Diagram_Subtree right_tree = done.items[--done.count];
+      Diagram_Subtree *left_tree = &done.items[done.count - 1];
+      size_t left = left_tree->leftmost_atom;
+      size_t right = right_tree.leftmost_atom;
+
+      size_t lowest_line_y = max(left_tree->lowest_y, right_tree.lowest_y);
+      if (depth > 0) lowest_line_y = max(lowest_line_y, depth - 1);
+
+      vertical->y1[right] = lowest_line_y + 1;
+      diagram->height = max(diagram->height, lowest_line_y + 1);
+
+      size_t line = horizontal->count++;
+      horizontal->x0[line] = vertical->x[left];
+      horizontal->x1[line] = vertical->x[right];
+      horizontal->y[line] = lowest_line_y + 1;
+      horizontal->kind[line] = LAMBDA_APPLICATION;
+      diagram->width = max(diagram->width, vertical->x[right]);
+
+      left_tree->lowest_y = lowest_line_y + 1;
+      finished = true;
+    } break;
     }
 
-    if (diagram.items[i].orientation == LINE_VERTICAL) {
-      diagram_height = max(diagram_height, diagram.items[i].end.y);
+    if (frame.memorize && finished) {
+      diagram_memo_insert(memo, store, frame.node, nodes[i].hash, diagram, frame.first_horizontal, frame.first_vertical,
+                          frame.breadth, depth, done.items[done.count - 1].lowest_y);
     }
   }
 
-  const Vector2 scale = {
-      .x = roundf((float)width / (diagram_width + 1)),
-      .y = roundf((float)height / (diagram_height + 1)),
-  };
+  assert(done.count == 1);
+  vertical->y1[done.items[0].leftmost_atom] = done.items[0].lowest_y + 1;
+  diagram->height = max(diagram->height, done.items[0].lowest_y + 1);
 
-  BeginDrawing();
-  ClearBackground(BLACK);
-
-  for (size_t i = 0; i < diagram.count; ++i) {
-    Line *line = &diagram.items[i];
+  nob_da_free(done);
+  nob_da_free(stack);
+}
 
-    Vector2 start = {.x = line->start.x, .y = diagram_height - line->start.y};
-    Vector2 end = {.x = line->end.x, .y = diagram_height - line->end.y};
+// Scales the diagram to fill width x height, flipped so that y grows upwards.
+static void diagram_draw(Diagram diagram, size_t width, size_t height, size_t line_width, double serif_multiplier) {
+  const Vector2 scale = {
+      .x = roundf((float)width / (diagram.width + 1)),
+      .y = roundf((float)height / (diagram.height + 1)),
+  };
+  const Vector2 margin = {3.0 * line_width, 0.0};
 
-    start = Vector2Multiply(start, scale);
-    end = Vector2Multiply(end, scale);
+  for (size_t i = 0; i < diagram.horizontal.count; ++i) {
+    if (diagram.horizontal.x0[i] == DIAGRAM_NO_LINE) continue;
+    float y = (float)diagram.height - diagram.horizontal.y[i];
+    Vector2 start = Vector2Multiply((Vector2){diagram.horizontal.x0[i], y}, scale);
+    Vector2 end = Vector2Multiply((Vector2){diagram.horizontal.x1[i], y}, scale);
 
-    if (line->kind == LAMBDA_ABSTRACTION) {
+    if (diagram.horizontal.kind[i] == LAMBDA_ABSTRACTION) {
       start.x -= serif_multiplier * line_width;
       end.x += serif_multiplier * line_width;
     }
 
-    if (line->orientation == LINE_VERTICAL) {
-      end.y -= 0.5 * line_width;
-    }
+    DrawLineEx(Vector2Add(start, margin), Vector2Add(end, margin), line_width, WHITE);
+  }
 
-    start = Vector2Add(start, (Vector2){3.0 * line_width, 0.0});
-    end = Vector2Add(end, (Vector2){3.0 * line_width, 0.0});
+  for (size_t i = 0; i < diagram.vertical.count; ++i) {
+    if (diagram.vertical.x[i] == DIAGRAM_NO_LINE) continue;
+    float x = diagram.vertical.x[i];
+    Vector2 start = Vector2Multiply((Vector2){x, (float)diagram.height - diagram.vertical.y0[i]}, scale);
+    Vector2 end = Vector2Multiply((Vector2){x, (float)diagram.height - diagram.vertical.y1[i]}, scale);
+    end.y -= 0.5 * line_width;
 
-    DrawLineEx(start, end, line_width, WHITE);
+    DrawLineEx(Vector2Add(start, margin), Vector2Add(end, margin), line_width, WHITE);
   }
+}
+
+void diagram_to_raylib_texture(RenderTexture2D texture, Diagram diagram, size_t line_width, double serif_multiplier) {
+  BeginTextureMode(texture);
+  ClearBackground(BLACK);
+  diagram_draw(diagram, texture.texture.width, texture.texture.height, line_width, serif_multiplier);
+  EndTextureMode();
+}
+
+void diagram_to_raylib_window(Diagram diagram, size_t line_width, double serif_multiplier) {
+  BeginDrawing();
+  ClearBackground(BLACK);
+  diagram_draw(diagram, GetRenderWidth(), GetRenderHeight(), line_width, serif_multiplier);
   EndDrawing();
 }
@@ -2,30 +2,100 @@
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <raylib.h>
 
 #include "parser.h"
+#include "term.h"
+
+/*
+ * A diagram as a struct of arrays: the horizontal lines (abstractions and applications) and the vertical lines
+ * (atoms) each have their own arrays, one per coordinate, 32 bits a coordinate and a byte for a horizontal line's
+ * kind, so a line takes 12 or 13 bytes and a pass over one coordinate reads nothing else. y grows downwards.
+ *
+ * The arrays of a diagram are allocated together, at the size of the biggest tree laid out in it so far, and are
+ * filled in by index, so one diagram can be laid out again and again without allocating.
+ *
+ * diagram_relayout updates a diagram after a beta step instead of laying it out again. It frees the lines of the
+ * redex, so slots can be free: their x0 (or x) is DIAGRAM_NO_LINE and their index is on a free list, to be reused
+ * by the next lines added.
+ */
+#define DIAGRAM_NO_LINE UINT32_MAX
+
+typedef struct {
+  uint32_t *x0, *x1; // from x0 to x1, at y
+  uint32_t *y;
+  uint8_t *kind; // LAMBDA_ABSTRACTION or LAMBDA_APPLICATION
+  size_t count;
+} Diagram_Horizontals;
+
+typedef struct {
+  uint32_t *x;
+  uint32_t *y0, *y1; // from y0 (the binder) down to y1
+  size_t count;
+} Diagram_Verticals;
 
 typedef struct {
-  size_t x, y;
-} Usize2;
+  Diagram_Horizontals horizontal;
+  Diagram_Verticals vertical;
+  uint32_t width; // the largest x a horizontal line reaches
+  uint32_t height; // the largest y a vertical line reaches
+  void *memory; // every array above lives here
+  size_t horizontal_capacity, vertical_capacity;
+  Vec(uint32_t) free_horizontal, free_vertical; // indices of free slots
+} Diagram;
 
-typedef enum {
-  LINE_HORIZONTAL,
-  LINE_VERTICAL,
-} Line_Orientation;
+#define diagram_line_count(diagram)                                                                               \
+  ((diagram).horizontal.count - (diagram).free_horizontal.count + (diagram).vertical.count -                      \
+   (diagram).free_vertical.count)
+
+/*
+ * Layouts of closed subterms, keyed by an alpha-invariant hash like the normal form memo (see memo.h), so every
+ * occurrence of a numeral or a combinator lands on the same entry whatever names it was written with.
+ *
+ * A closed subterm draws the same lines wherever it is, only shifted right by the atoms before it and down by the
+ * abstractions above it: no atom outside it is bound inside, none inside is bound outside, and its applications
+ * only ever go below lines of its own, which are all at its depth or lower. The one line it leaves open is its
+ * leftmost atom, which ends at an application outside. So an entry keeps the lines relative to the subterm's
+ * position and a later occurrence gets a copy of them, offset, instead of being laid out.
+ */
+typedef struct {
+  uint64_t hash; // 0 for an empty slot, hashes are made nonzero
+  Term_Index key; // in terms, TERM_NONE for a subterm seen once, whose lines are not kept (yet)
+  uint32_t first_horizontal, first_vertical; // the entry's lines in `lines`
+  uint32_t horizontals, verticals;
+  uint32_t lowest_y; // see Diagram_Subtree, like every coordinate below relative to the subterm's depth
+  uint32_t width; // the largest x its horizontal lines reach, relative to its leftmost atom
+  uint32_t height; // the lowest of its applications, 0 if it has none
+} Diagram_Memo_Entry;
+
+// What diagram_from_term needs to know about each node of a term before it lays the term out.
+typedef struct {
+  uint64_t hash; // of the node's subterm, built from its children's so that it is computed bottom-up in one pass
+  uint32_t free_index; // 1 + the largest free de Bruijn index in the subterm, 0 if it is closed
+  uint32_t size; // nodes in the subterm
+} Diagram_Memo_Node;
 
 typedef struct {
-  Usize2 start;
-  Usize2 end;
-  Line_Orientation orientation;
-  Lambda_Expr_Kind kind;
-} Line;
+  Term_Store terms;
+  Diagram lines; // every entry's lines, one entry after the other
+  Vec(Diagram_Memo_Node) nodes; // scratch, per node of the term being laid out
+  Diagram_Memo_Entry *entries;
+  size_t capacity; // a power of two, or 0
+  size_t count;
+  size_t hits;
+  size_t misses;
+} Diagram_Memo;
 
-typedef Vec(Line) Diagram;
+// Closed subterms smaller than this are laid out, since that costs less than looking them up.
+#define DIAGRAM_MEMO_MIN_NODES 8
 
 void diagram_from_lambda_tree(Diagram *diagram, Tree_Node *tree);
+void diagram_from_term(Diagram *diagram, const Term_Store *store, Term_Index root, Diagram_Memo *memo);
+void diagram_relayout(Diagram *diagram, Tree_Node *tree, Tree_Node *contracted, Tree_Node *contractum);
+void diagram_free(Diagram *diagram);
+void diagram_memo_free(Diagram_Memo *memo);
 
 void diagram_to_raylib_texture(RenderTexture2D texture, Diagram diagram, size_t line_width, double serif_multiplier);
 void diagram_to_raylib_window(Diagram diagram, size_t line_width, double serif_multiplier);
@@ -0,0 +1,504 @@
+#include "graph.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nob.h>
+
+#include "util.h"
+
+#define GRAPH_MEMO_INITIAL_CAPACITY 1024
+
+Memo *graph_memo = NULL;
+
+static Graph_Node *graph_alloc(Graph *graph) {
+  Graph_Node *node = graph->free_list;
+  if (node != NULL) {
+    graph->free_list = node->left;
+  } else {
+    node = arena_alloc(&graph->arena, sizeof(Graph_Node));
+    if (node == NULL) return NULL;
+  }
+
+  graph->live += 1;
+  graph->peak = max(graph->peak, graph->live);
+  return node;
+}
+
+// Takes over the caller's references to left and right.
+static Graph_Node *graph_new(Graph *graph, Lambda_Expr_Kind kind, uint32_t data, Graph_Node *left,
+                             Graph_Node *right) {
+  Graph_Node *node = graph_alloc(graph);
+  assert(node != NULL && "Out of memory");
+
+  node->refcount = 1;
+  node->kind = kind;
+  node->data = data;
+  node->left = left;
+  node->right = right;
+  node->source = TERM_NONE;
+
+  switch (kind) {
+  case LAMBDA_ATOM:
+    node->free = data + 1;
+    node->normal = true;
+    break;
+  case LAMBDA_ABSTRACTION:
+    node->free = (right->free > 0) ? right->free - 1 : 0;
+    node->normal = right->normal;
+    break;
+  case LAMBDA_APPLICATION:
+    node->free = max(left->free, right->free);
+    node->normal = left->normal && right->normal && left->kind != LAMBDA_ABSTRACTION;
+    break;
+  }
+
+  return node;
+}
+
+Graph_Node *graph_retain(Graph_Node *node) {
+  if (node != NULL) node->refcount += 1;
+  return node;
+}
+
+void graph_release(Graph *graph, Graph_Node *node) {
+  size_t base = graph->garbage.count;
+  nob_da_append(&graph->garbage, node);
+
+  while (graph->garbage.count > base) {
+    Graph_Node *curr = graph->garbage.items[--graph->garbage.count];
+    if (curr == NULL) continue;
+
+    assert(curr->refcount > 0 && "Releasing a dead graph node");
+    if (--curr->refcount > 0) continue;
+
+    nob_da_append(&graph->garbage, curr->left);
+    nob_da_append(&graph->garbage, curr->right);
+
+    curr->left = graph->free_list;
+    graph->free_list = curr;
+    graph->live -= 1;
+  }
+}
+
+void graph_free(Graph *graph) {
+  arena_free(&graph->arena);
+  nob_da_free(graph->garbage);
+  free(graph->shifts.entries);
+  free(graph->substitutions.entries);
+  nob_da_free(graph->tasks);
+  nob_da_free(graph->results);
+  nob_da_free(graph->spine);
+  *graph = (Graph){0};
+}
+
+Graph_Node *graph_from_term(Graph *graph, const Term_Store *store, Term_Index root) {
+  Term_Index start = term_subterm_start(store, root);
+  Graph_Node **nodes = malloc((root - start + 1) * sizeof(Graph_Node *));
+  assert(nodes != NULL && "Out of memory");
+
+  // Postorder, so both children of a node have already been built when we get to it.
+  for (Term_Index i = start; i <= root; ++i) {
+    Term_Node node = store->items[i];
+    Graph_Node *left = (node.left != TERM_NONE) ? nodes[node.left - start] : NULL;
+    Graph_Node *right = (node.right != TERM_NONE) ? nodes[node.right - start] : NULL;
+    nodes[i - start] = graph_new(graph, term_kind(node), term_data(node), left, right);
+    if (store == graph->source) nodes[i - start]->source = i;
+  }
+
+  Graph_Node *result = nodes[root - start];
+  free(nodes);
+  return result;
+}
+
+/*
+ * Writes out the term `root` stands for, shared nodes once per occurrence, so the store holds a plain tree. That can
+ * be exponentially bigger than the graph, so the budget's node and time limits apply to it: if it runs past either,
+ * the graph is stopped with that outcome and false returned, the store left with what was written so far.
+ */
+bool graph_to_term(Graph *graph, Term_Store *store, const Graph_Node *root, Term_Index *result) {
+  typedef struct {
+    const Graph_Node *node;
+    bool expanded;
+  } Frame;
+
+  Vec(Frame) stack = {0};
+  Vec(Term_Index) results = {0};
+  size_t start = store->count;
+  bool ok = true;
+
+  nob_da_append(&stack, ((Frame){.node = root}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    const Graph_Node *node = frame.node;
+
+    if (node->kind != LAMBDA_ATOM && !frame.expanded) {
+      nob_da_append(&stack, ((Frame){.node = node, .expanded = true}));
+      nob_da_append(&stack, ((Frame){.node = node->right}));
+      if (node->left != NULL) nob_da_append(&stack, ((Frame){.node = node->left}));
+      continue;
+    }
+
+    size_t written = store->count - start;
+    if ((graph->budget.max_nodes != 0 && written >= graph->budget.max_nodes) || store->count >= TERM_NONE) {
+      graph->outcome = REDUCE_NODE_LIMIT;
+      ok = false;
+      break;
+    }
+    if (graph->budget.max_seconds > 0 && written % REDUCE_CLOCK_INTERVAL == 0 &&
+        now_seconds() - graph->start > graph->budget.max_seconds) {
+      graph->outcome = REDUCE_TIME_LIMIT;
+      ok = false;
+      break;
+    }
+
+    if (node->kind == LAMBDA_ATOM) {
+      nob_da_append(&results, term_push_atom(store, node->data));
+    } else if (node->kind == LAMBDA_ABSTRACTION) {
+      Term_Index body = results.items[--results.count];
+      nob_da_append(&results, term_push(store, LAMBDA_ABSTRACTION, node->data, TERM_NONE, body));
+    } else {
+      Term_Index right = results.items[--results.count];
+      Term_Index left = results.items[--results.count];
+      nob_da_append(&results, term_push_application(store, left, right));
+    }
+  }
+
+  if (ok) *result = results.items[0];
+  else graph->stopped = true;
+  nob_da_free(stack);
+  nob_da_free(results);
+  return ok;
+}
+
+// splitmix64 finalizer
+static uint64_t graph_mix(uint64_t hash) {
+  hash ^= hash >> 30;
+  hash *= UINT64_C(0xbf58476d1ce4e5b9);
+  hash ^= hash >> 27;
+  hash *= UINT64_C(0x94d049bb133111eb);
+  return hash ^ (hash >> 31);
+}
+
+static size_t graph_memo_slot(const Graph_Memo *memo, const Graph_Node *node, uint32_t a, uint32_t b) {
+  return graph_mix((uint64_t)(uintptr_t)node ^ graph_mix((uint64_t)a << 32 | b)) & (memo->capacity - 1);
+}
+
+static bool graph_memo_get(const Graph_Memo *memo, const Graph_Node *node, uint32_t a, uint32_t b,
+                           Graph_Node **result) {
+  if (memo->capacity == 0) return false;
+  for (size_t i = graph_memo_slot(memo, node, a, b); memo->entries[i].stamp == memo->stamp;
+       i = (i + 1) & (memo->capacity - 1)) {
+    Graph_Memo_Entry entry = memo->entries[i];
+    if (entry.node == node && entry.a == a && entry.b == b) {
+      *result = entry.result;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void graph_memo_put(Graph_Memo *memo, const Graph_Node *node, uint32_t a, uint32_t b, Graph_Node *result) {
+  if (2 * (memo->count + 1) > memo->capacity) {
+    Graph_Memo old = *memo;
+    memo->capacity = old.capacity > 0 ? old.capacity * 2 : GRAPH_MEMO_INITIAL_CAPACITY;
+    memo->entries = calloc(memo->capacity, sizeof(Graph_Memo_Entry));
+    assert(memo->entries != NULL && "Out of memory");
+    memo->stamp = 1;
+    memo->count = 0;
+    for (size_t i = 0; i < old.capacity; ++i) {
+      Graph_Memo_Entry entry = old.entries[i];
+      if (entry.stamp == old.stamp) graph_memo_put(memo, entry.node, entry.a, entry.b, entry.result);
+    }
+    free(old.entries);
+  }
+
+  size_t i = graph_memo_slot(memo, node, a, b);
+  while (memo->entries[i].stamp == memo->stamp) i = (i + 1) & (memo->capacity - 1);
+  memo->entries[i] = (Graph_Memo_Entry){.node = node, .a = a, .b = b, .stamp = memo->stamp, .result = result};
+  memo->count += 1;
+}
+
+static void graph_memo_clear(Graph_Memo *memo) {
+  memo->stamp += 1;
+  memo->count = 0;
+  if (memo->stamp == 0) {
+    // Wrapped around, old stamps would look current again.
+    memset(memo->entries, 0, memo->capacity * sizeof(Graph_Memo_Entry));
+    memo->stamp = 1;
+  }
+}
+
+/*
+ * Runs a shift or a substitution to the end and returns a new reference to the result. Shifting shifts the atoms
+ * bound at or above the cutoff up, substituting replaces the atom bound `depth` abstractions above with `argument`
+ * (shifted up by depth) and shifts the atoms bound further out down by one. Subgraphs with nothing to change are
+ * shared as they are, and so is the argument itself unless it has free atoms that need lifting.
+ */
+static Graph_Node *graph_rewrite(Graph *graph, Graph_Task task, Graph_Node *argument) {
+  graph->tasks.count = 0;
+  graph->results.count = 0;
+
+  nob_da_append(&graph->tasks, task);
+  while (graph->tasks.count > 0) {
+    task = graph->tasks.items[--graph->tasks.count];
+    Graph_Node *node = task.node;
+    bool shift = task.kind == GRAPH_SHIFT || task.kind == GRAPH_SHIFTED;
+    Graph_Memo *memo = shift ? &graph->shifts : &graph->substitutions;
+    Graph_Node *result;
+
+    if (task.kind == GRAPH_SHIFTED || task.kind == GRAPH_SUBSTITUTED) {
+      if (node->kind == LAMBDA_ABSTRACTION) {
+        Graph_Node *body = graph->results.items[--graph->results.count];
+        result = graph_new(graph, LAMBDA_ABSTRACTION, node->data, NULL, body);
+      } else {
+        Graph_Node *right = graph->results.items[--graph->results.count];
+        Graph_Node *left = graph->results.items[--graph->results.count];
+        result = graph_new(graph, LAMBDA_APPLICATION, 0, left, right);
+      }
+      graph_memo_put(memo, node, task.a, task.b, result);
+      nob_da_append(&graph->results, result);
+      continue;
+    }
+
+    uint32_t untouched = shift ? task.b : task.a; // free atoms below this are left alone
+    if ((shift && task.a == 0) || node->free <= untouched) {
+      nob_da_append(&graph->results, graph_retain(node));
+      continue;
+    }
+    if (graph_memo_get(memo, node, task.a, task.b, &result)) {
+      nob_da_append(&graph->results, graph_retain(result));
+      continue;
+    }
+
+    Graph_Task_Kind rebuild = shift ? GRAPH_SHIFTED : GRAPH_SUBSTITUTED;
+    switch ((Lambda_Expr_Kind)node->kind) {
+    case LAMBDA_ATOM:
+      if (shift) {
+        result = graph_new(graph, LAMBDA_ATOM, node->data + task.a, NULL, NULL);
+      } else if (node->data == task.a) {
+        nob_da_append(&graph->tasks, ((Graph_Task){.kind = GRAPH_SHIFT, .node = argument, .a = task.a, .b = 0}));
+        continue;
+      } else {
+        result = graph_new(graph, LAMBDA_ATOM, node->data - 1, NULL, NULL);
+      }
+      graph_memo_put(memo, node, task.a, task.b, result);
+      nob_da_append(&graph->results, result);
+      break;
+    case LAMBDA_ABSTRACTION: {
+      Graph_Task body = {.kind = task.kind, .node = node->right, .a = task.a, .b = task.b};
+      if (shift) body.b += 1;
+      else body.a += 1;
+      nob_da_append(&graph->tasks, ((Graph_Task){.kind = rebuild, .node = node, .a = task.a, .b = task.b}));
+      nob_da_append(&graph->tasks, body);
+    } break;
+    case LAMBDA_APPLICATION:
+      nob_da_append(&graph->tasks, ((Graph_Task){.kind = rebuild, .node = node, .a = task.a, .b = task.b}));
+      nob_da_append(&graph->tasks, ((Graph_Task){.kind = task.kind, .node = node->right, .a = task.a, .b = task.b}));
+      nob_da_append(&graph->tasks, ((Graph_Task){.kind = task.kind, .node = node->left, .a = task.a, .b = task.b}));
+      break;
+    }
+  }
+
+  assert(graph->results.count == 1);
+  return graph->results.items[0];
+}
+
+// Overwrites `node` with `result` (taking over the reference) so every node sharing it sees the result.
+static void graph_overwrite(Graph *graph, Graph_Node *node, Graph_Node *result) {
+  Graph_Node *old_left = node->left;
+  Graph_Node *old_right = node->right;
+
+  node->kind = result->kind;
+  node->data = result->data;
+  node->free = result->free;
+  node->normal = result->normal;
+  node->left = graph_retain(result->left);
+  node->right = graph_retain(result->right);
+
+  graph_release(graph, result);
+  graph_release(graph, old_left);
+  graph_release(graph, old_right);
+}
+
+// Overwrites the redex `node` with its contractum.
+static void graph_contract(Graph *graph, Graph_Node *node) {
+  assert(node->kind == LAMBDA_APPLICATION && node->left->kind == LAMBDA_ABSTRACTION);
+
+  graph_memo_clear(&graph->shifts);
+  graph_memo_clear(&graph->substitutions);
+  Graph_Task task = {.kind = GRAPH_SUBSTITUTE, .node = node->left->right, .a = 0, .b = 0};
+  graph_overwrite(graph, node, graph_rewrite(graph, task, node->right));
+  graph->steps += 1;
+}
+
+static bool graph_memoizable(const Graph *graph, const Graph_Node *node) {
+  return graph->memo != NULL && node->source != TERM_NONE && node->free == 0;
+}
+
+// Replaces `node` with its normal form if the memo has it.
+static bool graph_recall(Graph *graph, Graph_Node *node) {
+  if (!graph_memoizable(graph, node)) return false;
+
+  uint64_t hash = graph->source_hashes[node->source - graph->source_start];
+  Term_Index normal_form;
+  if (!memo_lookup(graph->memo, graph->source, node->source, hash, &normal_form)) return false;
+
+  graph_overwrite(graph, node, graph_from_term(graph, &graph->memo->terms, normal_form));
+  node->normal = true;
+  return true;
+}
+
+static void graph_memorize(Graph *graph, Graph_Node *node, size_t steps) {
+  if (!graph_memoizable(graph, node)) return;
+
+  uint64_t hash = graph->source_hashes[node->source - graph->source_start];
+  size_t count = graph->memo->terms.count;
+  Term_Index normal_form;
+  if (!graph_to_term(graph, &graph->memo->terms, node, &normal_form)) {
+    graph->memo->terms.count = count;
+    return;
+  }
+  memo_insert(graph->memo, graph->source, node->source, hash, normal_form, steps);
+}
+
+/*
+ * Contracts head redexes until the head is stuck. Getting to the head means bringing the function of every
+ * application on the left spine to weak head normal form first; the spine is kept on a stack rather than the C
+ * one, each application marked once its function is done.
+ */
+void graph_whnf(Graph *graph, Graph_Node *node) {
+  if (!node->normal) graph_recall(graph, node);
+  graph->spine.count = 0;
+  nob_da_append(&graph->spine, ((Graph_Spine){.node = node}));
+
+  while (graph->spine.count > 0 && !graph->stopped) {
+    Graph_Spine *top = &graph->spine.items[graph->spine.count - 1];
+    node = top->node;
+    if (node->kind != LAMBDA_APPLICATION) {
+      graph->spine.count -= 1;
+      continue;
+    }
+
+    if (!top->function) {
+      top->function = true;
+      if (!node->left->normal) graph_recall(graph, node->left);
+      nob_da_append(&graph->spine, ((Graph_Spine){.node = node->left}));
+      continue;
+    }
+
+    if (node->left->kind != LAMBDA_ABSTRACTION) {
+      graph->spine.count -= 1;
+      continue;
+    }
+    if (reduce_budget_exhausted(graph->budget, graph->steps, graph->live, graph->start, &graph->outcome)) {
+      graph->stopped = true;
+      break;
+    }
+    graph_contract(graph, node);
+    top->function = false;
+  }
+}
+
+/*
+ * Normal order: the head is brought to weak head normal form first, and only once it turns out not to be a
+ * redex do we descend into the arguments and under abstractions. Subgraphs already marked normal are skipped,
+ * which is what makes a shared argument cost one normalization no matter how often it occurs, and closed input
+ * subterms go through the memo table, if there is one. When the budget runs out the graph is left as it is, partially
+ * reduced but still a valid term. Like graph_whnf it keeps its own stack: a node is expanded into its children, left
+ * on top, and marked normal once they all are.
+ */
+void graph_normalize(Graph *graph, Graph_Node *node) {
+  typedef struct {
+    Graph_Node *node;
+    size_t steps; // graph->steps when the node was expanded
+    bool expanded;
+  } Frame;
+
+  Vec(Frame) stack = {0};
+  nob_da_append(&stack, ((Frame){.node = node}));
+  while (stack.count > 0 && !graph->stopped) {
+    Frame frame = stack.items[--stack.count];
+    node = frame.node;
+
+    if (frame.expanded) {
+      node->normal = true;
+      graph_memorize(graph, node, graph->steps - frame.steps);
+      continue;
+    }
+
+    if (node->normal || graph_recall(graph, node)) continue;
+    size_t steps = graph->steps;
+    graph_whnf(graph, node);
+    if (graph->stopped) break;
+
+    nob_da_append(&stack, ((Frame){.node = node, .steps = steps, .expanded = true}));
+    switch ((Lambda_Expr_Kind)node->kind) {
+    case LAMBDA_ATOM:
+      break;
+    case LAMBDA_ABSTRACTION:
+      nob_da_append(&stack, ((Frame){.node = node->right}));
+      break;
+    case LAMBDA_APPLICATION:
+      nob_da_append(&stack, ((Frame){.node = node->right}));
+      nob_da_append(&stack, ((Frame){.node = node->left}));
+      break;
+    }
+  }
+
+  nob_da_free(stack);
+}
+
+bool graph_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats) {
+  Term_Store store = {0};
+  Graph graph = {.budget = budget, .start = now_seconds()};
+  *stats = (Reduce_Stats){.outcome = REDUCE_ERROR};
+  bool ok = false;
+
+  Term_Index root;
+  if (!term_from_tree(&store, *tree, &root)) goto done;
+
+  if (graph_memo != NULL) {
+    graph.memo = graph_memo;
+    graph.source = &store;
+    graph.source_start = term_subterm_start(&store, root);
+    graph.source_hashes = malloc((root - graph.source_start + 1) * sizeof(uint64_t));
+    assert(graph.source_hashes != NULL && "Out of memory");
+    term_hashes(&store, root, graph.source_hashes);
+  }
+
+  Graph_Node *node = graph_from_term(&graph, &store, root);
+  graph_normalize(&graph, node);
+
+  store.count = 0;
+  bool written = graph_to_term(&graph, &store, node, &root);
+  graph_release(&graph, node);
+
+  stats->outcome = graph.stopped ? graph.outcome : REDUCE_NORMAL_FORM;
+  stats->steps = graph.steps;
+  stats->nodes = store.count;
+  stats->peak_nodes = graph.peak;
+  if (!written) {
+    // Too big to write out: the tree is left as it was, like the other engines leave it when they stop.
+    ok = true;
+    goto done;
+  }
+
+  Tree_Node *result = tree_new_node(arena);
+  if (result == NULL || !term_to_tree(arena, result, &store, root)) {
+    stats->outcome = REDUCE_ERROR;
+    goto done;
+  }
+  tree_discard(arena, *tree);
+  *tree = result;
+  ok = true;
+
+done:
+  stats->seconds = now_seconds() - graph.start;
+  free(graph.source_hashes);
+  graph_free(&graph);
+  nob_da_free(store);
+  return ok;
+}
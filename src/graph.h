@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "memo.h"
+#include "parser.h"
+#include "reduce.h"
+#include "term.h"
+#include "util.h"
+
+/*
+ * Sharing graph reduction (call-by-need).
+ *
+ * Terms are reference-counted DAGs of de Bruijn nodes. Contracting (lx.M)N does not copy N into every occurrence
+ * of x: N is shared by reference whenever it is closed, and the parts of M that do not mention x are shared with
+ * the original abstraction. Redexes are overwritten in place with their contractum, so a shared argument is
+ * reduced once and every occurrence sees the result. Nodes are returned to a free list as soon as their
+ * reference count drops to zero.
+ *
+ * With a memo table, every closed subterm of the input is looked up before it is normalized, and its normal form
+ * recorded once it is, so a subterm that occurs many times (or in many terms) is only normalized once.
+ */
+
+typedef struct Graph_Node {
+  uint32_t refcount;
+  uint8_t kind; // Lambda_Expr_Kind
+  bool normal; // subgraph is known to be in beta normal form
+  uint32_t free; // upper bound on 1 + the largest free de Bruijn index, 0 if closed
+  uint32_t data; // LAMBDA_ATOM: de Bruijn index, LAMBDA_ABSTRACTION: name of the bound atom
+  struct Graph_Node *left; // LAMBDA_APPLICATION: function
+  struct Graph_Node *right; // LAMBDA_APPLICATION: argument, LAMBDA_ABSTRACTION: body
+  Term_Index source; // the input subterm this node was built from and is still convertible to, or TERM_NONE
+} Graph_Node;
+
+/*
+ * Results of shifting and substituting within one contraction, keyed by the node and the two parameters of the
+ * call, so a shared subgraph is rebuilt once rather than once per path leading to it. Bumping the stamp empties it.
+ */
+typedef struct {
+  const Graph_Node *node;
+  uint32_t a, b;
+  uint32_t stamp;
+  Graph_Node *result; // not a reference of its own, the contractum holds it
+} Graph_Memo_Entry;
+
+typedef struct {
+  Graph_Memo_Entry *entries;
+  size_t capacity;
+  size_t count; // entries with the current stamp
+  uint32_t stamp;
+} Graph_Memo;
+
+typedef enum {
+  GRAPH_SHIFT, // shift `node` by a, atoms bound at or above b
+  GRAPH_SUBSTITUTE, // substitute the argument for the atom bound a abstractions above `node`
+  GRAPH_SHIFTED, // the children of `node` are on the result stack, rebuild it
+  GRAPH_SUBSTITUTED,
+} Graph_Task_Kind;
+
+typedef struct {
+  Graph_Task_Kind kind;
+  Graph_Node *node;
+  uint32_t a, b; // the memo key, along with the node
+} Graph_Task;
+
+typedef struct {
+  Graph_Node *node; // an application on the left spine of the term graph_whnf was given
+  bool function; // its function is in weak head normal form
+} Graph_Spine;
+
+typedef struct {
+  Arena arena;
+  Graph_Node *free_list;
+  Vec(Graph_Node *) garbage;
+
+  size_t live; // nodes currently allocated
+  size_t peak; // max of live so far
+  size_t steps; // beta contractions performed
+
+  Reduce_Budget budget; // checked before every contraction against live nodes, and by graph_to_term
+  double start; // now_seconds() when the budget started counting
+  Reduce_Outcome outcome; // why reduction stopped, if stopped
+  bool stopped;
+
+  // Terms are as deep as they are long, so nothing walks them recursively: these are the explicit stacks, kept to be
+  // reused from one contraction to the next.
+  Graph_Memo shifts; // (node, shift, cutoff)
+  Graph_Memo substitutions; // (node, depth, 0)
+  Vec(Graph_Task) tasks;
+  Vec(Graph_Node *) results;
+  Vec(Graph_Spine) spine;
+
+  Memo *memo; // NULL for none
+  const Term_Store *source; // the input term
+  Term_Index source_start; // first node of the input term
+  uint64_t *source_hashes; // term_hashes of the input term
+} Graph;
+
+extern Memo *graph_memo; // used by graph_normalize_tree, NULL for none
+
+Graph_Node *graph_from_term(Graph *graph, const Term_Store *store, Term_Index root);
+bool graph_to_term(Graph *graph, Term_Store *store, const Graph_Node *root, Term_Index *result);
+
+Graph_Node *graph_retain(Graph_Node *node);
+void graph_release(Graph *graph, Graph_Node *node);
+void graph_free(Graph *graph);
+
+void graph_whnf(Graph *graph, Graph_Node *node);
+void graph_normalize(Graph *graph, Graph_Node *node);
+
+bool graph_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats);
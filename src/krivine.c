@@ -0,0 +1,211 @@
+#include "krivine.h"
+
+#include <assert.h>
+
+#include <nob.h>
+
+typedef struct Krivine_Cell Krivine_Cell;
+
+typedef struct {
+  Term_Index term; // TERM_NONE for a variable introduced by readback
+  uint32_t level; // readback variables only: how many abstractions of the result enclose its binder
+  Krivine_Cell *env;
+} Krivine_Closure;
+
+// One cell type for both environments and the argument stack, so a popped argument can become an environment entry.
+struct Krivine_Cell {
+  Krivine_Closure value;
+  Krivine_Cell *next;
+};
+
+typedef struct {
+  const Term_Store *store;
+  Arena arena;
+  size_t cells;
+
+  Reduce_Budget budget;
+  Reduce_Stats *stats;
+  double start;
+} Krivine;
+
+static Krivine_Cell *krivine_cons(Krivine *machine, Krivine_Closure value, Krivine_Cell *next) {
+  Krivine_Cell *cell = arena_alloc(&machine->arena, sizeof(Krivine_Cell));
+  assert(cell != NULL && "Out of memory");
+  cell->value = value;
+  cell->next = next;
+  machine->cells += 1;
+  return cell;
+}
+
+/*
+ * Runs the machine on `closure` with an empty stack until it reaches a weak head normal form. That is either an
+ * abstraction closure (returned in `closure`, with `*stack` empty) or a readback variable applied to the closures
+ * left on `*stack`, first argument on top. Returns false if the budget ran out first.
+ */
+static bool krivine_whnf(Krivine *machine, Krivine_Closure *closure, Krivine_Cell **stack) {
+  Term_Index term = closure->term;
+  Krivine_Cell *env = closure->env;
+  Krivine_Cell *args = NULL;
+
+  for (;;) {
+    Term_Node node = machine->store->items[term];
+    switch (term_kind(node)) {
+    case LAMBDA_APPLICATION:
+      args = krivine_cons(machine, (Krivine_Closure){.term = node.right, .env = env}, args);
+      term = node.left;
+      break;
+
+    case LAMBDA_ABSTRACTION: {
+      if (args == NULL) {
+        *closure = (Krivine_Closure){.term = term, .env = env};
+        *stack = NULL;
+        return true;
+      }
+
+      Reduce_Stats *stats = machine->stats;
+      if (reduce_budget_exhausted(machine->budget, stats->steps, machine->cells, machine->start, &stats->outcome)) {
+        return false;
+      }
+
+      // Nothing else points at a stack cell, so it is relinked into the environment instead of copied.
+      Krivine_Cell *cell = args;
+      args = args->next;
+      cell->next = env;
+      env = cell;
+      term = node.right;
+      stats->steps += 1;
+    } break;
+
+    case LAMBDA_ATOM: {
+      Krivine_Cell *cell = env;
+      for (uint32_t i = term_data(node); i > 0; --i) cell = cell->next;
+      assert(cell != NULL && "Open term");
+
+      if (cell->value.term == TERM_NONE) {
+        *closure = cell->value;
+        *stack = args;
+        return true;
+      }
+      term = cell->value.term;
+      env = cell->value.env;
+    } break;
+    }
+  }
+}
+
+/*
+ * The readback is driven by an explicit task stack so deep normal forms cannot overflow the C stack. Results are
+ * pushed to the store in postorder: a stuck variable is written as soon as it is found, then each argument is
+ * normalized and immediately applied, so every subterm still ends up contiguous.
+ */
+typedef enum {
+  KRIVINE_TASK_EVAL, // normalize closure under `depth` abstractions of the result
+  KRIVINE_TASK_ABSTRACTION, // wrap the last result in an abstraction named `name`
+  KRIVINE_TASK_APPLICATION, // apply the second to last result to the last one
+} Krivine_Task_Kind;
+
+typedef struct {
+  Krivine_Task_Kind kind;
+  uint32_t depth;
+  Symbol name;
+  Krivine_Closure closure;
+} Krivine_Task;
+
+bool krivine_normalize(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *result,
+                       Reduce_Budget budget, Reduce_Stats *stats) {
+  Krivine machine = {.store = src, .budget = budget, .stats = stats, .start = now_seconds()};
+  *stats = (Reduce_Stats){.outcome = REDUCE_NORMAL_FORM};
+
+  Vec(Krivine_Task) tasks = {0};
+  Vec(Term_Index) results = {0};
+  Vec(Krivine_Closure) args = {0};
+  bool ok = true;
+
+  nob_da_append(&tasks, ((Krivine_Task){.kind = KRIVINE_TASK_EVAL, .closure = {.term = root}}));
+  while (tasks.count > 0) {
+    Krivine_Task task = tasks.items[--tasks.count];
+
+    switch (task.kind) {
+    case KRIVINE_TASK_EVAL: {
+      Krivine_Cell *stack;
+      if (!krivine_whnf(&machine, &task.closure, &stack)) {
+        ok = false;
+        goto done;
+      }
+
+      if (task.closure.term != TERM_NONE) {
+        Term_Node node = src->items[task.closure.term];
+        Krivine_Closure fresh = {.term = TERM_NONE, .level = task.depth};
+        Krivine_Closure body = {.term = node.right, .env = krivine_cons(&machine, fresh, task.closure.env)};
+
+        nob_da_append(&tasks, ((Krivine_Task){.kind = KRIVINE_TASK_ABSTRACTION, .name = term_data(node)}));
+        nob_da_append(&tasks, ((Krivine_Task){.kind = KRIVINE_TASK_EVAL, .depth = task.depth + 1, .closure = body}));
+        break;
+      }
+
+      nob_da_append(&results, term_push_atom(dst, task.depth - 1 - task.closure.level));
+
+      args.count = 0;
+      for (Krivine_Cell *cell = stack; cell != NULL; cell = cell->next) nob_da_append(&args, cell->value);
+      for (size_t i = args.count; i > 0; --i) {
+        nob_da_append(&tasks, ((Krivine_Task){.kind = KRIVINE_TASK_APPLICATION}));
+        nob_da_append(&tasks, ((Krivine_Task){.kind = KRIVINE_TASK_EVAL, .depth = task.depth,
+                                              .closure = args.items[i - 1]}));
+      }
+    } break;
+
+    case KRIVINE_TASK_ABSTRACTION: {
+      Term_Index body = results.items[--results.count];
+      nob_da_append(&results, term_push_abstraction(dst, task.name, body));
+    } break;
+
+    case KRIVINE_TASK_APPLICATION: {
+      Term_Index argument = results.items[--results.count];
+      Term_Index function = results.items[--results.count];
+      nob_da_append(&results, term_push_application(dst, function, argument));
+    } break;
+    }
+  }
+
+  assert(results.count == 1);
+  *result = results.items[0];
+  stats->nodes = *result - term_subterm_start(dst, *result) + 1;
+
+done:
+  stats->peak_nodes = machine.cells;
+  stats->seconds = now_seconds() - machine.start;
+  arena_free(&machine.arena);
+  nob_da_free(tasks);
+  nob_da_free(results);
+  nob_da_free(args);
+  return ok;
+}
+
+bool krivine_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats) {
+  Term_Store src = {0};
+  Term_Store dst = {0};
+  *stats = (Reduce_Stats){.outcome = REDUCE_ERROR};
+  bool ok = false;
+
+  Term_Index root, result;
+  if (!term_from_tree(&src, *tree, &root)) goto done;
+  if (!krivine_normalize(&dst, &src, root, &result, budget, stats)) {
+    // Unlike the other engines there is no partially reduced term to hand back, so the tree stays as it was.
+    ok = stats->outcome != REDUCE_ERROR;
+    goto done;
+  }
+
+  Tree_Node *node = tree_new_node(arena);
+  if (node == NULL || !term_to_tree(arena, node, &dst, result)) {
+    stats->outcome = REDUCE_ERROR;
+    goto done;
+  }
+  tree_discard(arena, *tree);
+  *tree = node;
+  ok = true;
+
+done:
+  nob_da_free(src);
+  nob_da_free(dst);
+  return ok;
+}
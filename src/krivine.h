@@ -0,0 +1,23 @@
+#pragma once
+
+#include "parser.h"
+#include "reduce.h"
+#include "term.h"
+#include "util.h"
+
+/*
+ * Krivine machine (call-by-name environment machine).
+ *
+ * Instead of substituting, the machine carries closures: a term paired with an environment that says what each of
+ * its free de Bruijn indices stands for. A beta step just moves the closure on top of the argument stack into the
+ * environment, so nothing is ever copied. The machine alone stops at weak head normal form; the full normal form
+ * is read back by running it again under every abstraction (with a fresh variable bound to it) and on every
+ * argument of a stuck variable, building the result into a Term_Store in postorder.
+ *
+ * Steps count beta steps, nodes count the environment and stack cells the machine has allocated. If the budget runs
+ * out there is no result, krivine_normalize returns false and krivine_normalize_tree leaves the tree unchanged.
+ */
+
+bool krivine_normalize(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *result,
+                       Reduce_Budget budget, Reduce_Stats *stats);
+bool krivine_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats);
@@ -1,11 +1,27 @@
 #include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <raylib.h>
 #include <raymath.h>
 
+#include "blc.h"
+#include "dag.h"
 #include "diagram.h"
+#include "graph.h"
+#include "krivine.h"
+#include "memo.h"
+#include "nbe.h"
+#include "optimal.h"
+#include "parallel.h"
 #include "parser.h"
+#include "reduce.h"
 
 #define SV_IMPLEMENTATION
 #include <sv.h>
@@ -13,143 +29,428 @@
 #include <nob.h>
 
 
+/*
+ * Every engine besides the tree reducer goes from a term straight to its normal form, there is nothing in between
+ * to step through.
+ */
 typedef struct {
-  Tree_Node *dst;
-  Tree_Node *src;
-} Node_Pair;
-
-bool tree_copy_subtree_to_node(Tree_Node *dst, Tree_Node *src) {
-  if (dst == NULL) return false;
-  tree_free(dst->left);
-  tree_free(dst->right);
-  dst->left = NULL;
-  dst->right = NULL;
-
-  if (src == NULL) {
-    dst = NULL;
+  const char *name;
+  bool (*normalize)(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats);
+} Engine;
+
+static const Engine engines[] = {
+    {"tree", NULL},
+    {"sharing", graph_normalize_tree},
+    {"krivine", krivine_normalize_tree},
+    {"nbe", nbe_normalize_tree},
+    {"optimal", optimal_normalize_tree},
+    {"parallel", parallel_normalize_tree},
+    {"dag", dag_normalize_tree},
+};
+
+typedef struct {
+  const Engine *engine;
+  bool normalize;
+  bool memo;
+  const char *memo_file;
+  Reduce_Strategy strategy;
+  Reduce_Budget budget;
+  size_t bench_parse; // largest term to parse in the parse benchmark, in bytes, 0 to not run it
+  const char *corpus; // file of terms to stream through, one per line, "-" for stdin
+  bool blc_input; // the term is given as a BLC bit string rather than text
+  bool blc_output; // terms are printed as BLC bit strings rather than text
+  const char *blc_in; // file to read the term from, packed BLC
+  const char *blc_out; // file to write the normal form to, packed BLC
+  bool graphviz; // print the tree as Graphviz whenever the window shows a new one
+  bool diagram_memo; // corpus: reuse the layouts of closed subterms from term to term
+  const char *term;
+} Cli_Args;
+
+bool parse_args(int argc, char **argv, Cli_Args *args) {
+  for (size_t i = 1; i < (size_t)argc; ++i) {
+    char *arg = argv[i];
+    bool has_value = i + 1 < (size_t)argc;
+
+    if (strcmp(arg, "engine") == 0 && has_value) {
+      args->engine = NULL;
+      for (size_t j = 0; j < NOB_ARRAY_LEN(engines); ++j) {
+        if (strcmp(argv[i + 1], engines[j].name) == 0) args->engine = &engines[j];
+      }
+      if (args->engine == NULL) {
+        fprintf(stderr, "Unknown engine '%s'.\n", argv[i + 1]);
+        return false;
+      }
+      i += 1;
+    } else if (strcmp(arg, "normalize") == 0) {
+      args->normalize = true;
+    } else if (strcmp(arg, "graphviz") == 0) {
+      args->graphviz = true;
+    } else if (strcmp(arg, "diagram-memo") == 0) {
+      args->diagram_memo = true;
+    } else if (strcmp(arg, "memo") == 0) {
+      args->memo = true;
+    } else if (strcmp(arg, "memo-file") == 0 && has_value) {
+      args->memo = true;
+      args->memo_file = argv[++i];
+    } else if (strcmp(arg, "strategy") == 0 && has_value) {
+      if (!reduce_strategy_from_name(argv[++i], &args->strategy)) {
+        fprintf(stderr, "Unknown reduction strategy '%s'.\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(arg, "max-steps") == 0 && has_value) {
+      args->budget.max_steps = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "max-nodes") == 0 && has_value) {
+      args->budget.max_nodes = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "max-seconds") == 0 && has_value) {
+      args->budget.max_seconds = strtod(argv[++i], NULL);
+    } else if (strcmp(arg, "detect-loops") == 0) {
+      args->budget.detect_loops = true;
+    } else if ((strcmp(arg, "syntax") == 0 || strcmp(arg, "output-syntax") == 0) && has_value) {
+      i += 1;
+      bool blc = strcmp(argv[i], "blc") == 0;
+      if (!blc && strcmp(argv[i], "text") != 0) {
+        fprintf(stderr, "Unknown syntax '%s'.\n", argv[i]);
+        return false;
+      }
+      if (strcmp(arg, "syntax") == 0) args->blc_input = blc;
+      args->blc_output = blc;
+    } else if (strcmp(arg, "blc-in") == 0 && has_value) {
+      args->blc_in = argv[++i];
+    } else if (strcmp(arg, "blc-out") == 0 && has_value) {
+      args->blc_out = argv[++i];
+    } else if (strcmp(arg, "corpus") == 0 && has_value) {
+      args->corpus = argv[++i];
+    } else if (strcmp(arg, "bench-parse") == 0 && has_value) {
+      args->bench_parse = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "threads") == 0 && has_value) {
+      parallel_threads = strtoull(argv[++i], NULL, 10);
+    } else if (args->term == NULL) {
+      args->term = arg;
+    } else {
+      fprintf(stderr, "Unexpected argument '%s'.\n", arg);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void print_stats(Reduce_Stats stats) {
+  if (stats.outcome == REDUCE_CYCLE) {
+    printf("cycle detected at step %zu, period %zu", stats.steps, stats.cycle_period);
+  } else {
+    printf("%s after %zu steps", reduce_outcome_name(stats.outcome), stats.steps);
+  }
+  printf(" (%zu nodes, peak %zu, %.3fs)\n", stats.nodes, stats.peak_nodes, stats.seconds);
+}
+
+// Sets the reducer up with `term`, in whichever syntax it was given, reusing the reducer's memory.
+bool load_term(Cli_Args args, String_View term, Reducer *reducer) {
+  if (!args.blc_input && args.blc_in == NULL) return reducer_load(reducer, term);
+
+  reducer_reset(reducer);
+  Term_Store store = {0};
+  Nob_String_Builder file = {0};
+  Term_Index root;
+  bool ok;
+  if (args.blc_in != NULL) {
+    ok = nob_read_entire_file(args.blc_in, &file) &&
+         blc_read_bytes(&store, (const uint8_t *)file.items, file.count, &root);
+  } else {
+    ok = blc_read_bits(&store, term.data, term.count, &root);
+  }
+
+  Arena *arena = &reducer->generations[reducer->generation];
+  Tree_Node *tree = ok ? tree_new_node(arena) : NULL;
+  ok = tree != NULL && term_to_tree(arena, tree, &store, root);
+  if (ok) reducer_set_tree(reducer, tree);
+
+  nob_da_free(store);
+  nob_sb_free(file);
+  return ok;
+}
+
+// Appends the term to `sb` in the output syntax.
+bool append_term(Cli_Args args, Tree_Node *tree, Nob_String_Builder *sb) {
+  if (!args.blc_output) {
+    tree_node_label(sb, tree);
     return true;
   }
 
-  Vec(Node_Pair) stack = {0};
-  nob_da_append(&stack, ((Node_Pair){.dst = dst, .src = src}));
+  Term_Store store = {0};
+  Term_Index root;
+  bool ok = term_from_tree(&store, tree, &root);
+  if (ok) blc_write_bits(sb, &store, root);
+  nob_da_free(store);
+  return ok;
+}
 
-  Tree_Node *binder_lookup[256] = {0};
-  while (stack.count > 0) {
-    Node_Pair curr = stack.items[--stack.count];
+// Prints the term in the output syntax, and writes it to the BLC output file if there is one.
+bool print_term(Cli_Args args, Tree_Node *tree) {
+  Term_Store store = {0};
+  Nob_String_Builder sb = {0};
+  Term_Index root;
 
-    if (curr.src->kind == LAMBDA_ABSTRACTION) {
-      // Nob_String_Builder sb = {0};
-      // tree_node_label(&sb, curr.src);
-      // printf("binder_lookup[%c] = "SB_Fmt"\n", curr.src->left->atom, SB_Arg(sb));
-      // nob_sb_free(sb);
+  bool ok = append_term(args, tree, &sb);
+  if (ok) printf(SB_Fmt "\n", SB_Arg(sb));
 
-      binder_lookup[(size_t)curr.src->left->atom] = curr.dst;
-    };
+  if (ok && args.blc_out != NULL) {
+    sb.count = 0;
+    ok = term_from_tree(&store, tree, &root);
+    if (ok) blc_write_bytes(&sb, &store, root);
+    ok = ok && nob_write_entire_file(args.blc_out, sb.items, sb.count);
+  }
 
+  nob_da_free(store);
+  nob_sb_free(sb);
+  return ok;
+}
 
-    // this is a copy
-    curr.dst->kind      = curr.src->kind;
-    curr.dst->binder    = (curr.src->kind == LAMBDA_ATOM && binder_lookup[(size_t)curr.src->atom] != NULL)
-                            ? binder_lookup[(size_t)curr.src->atom]
-                            : curr.src->binder;
-    curr.dst->atom      = curr.src->atom;
-    curr.dst->user_data = curr.src->user_data;
+// Normalizes the reducer's tree with the chosen engine.
+bool run_engine(Cli_Args args, Reducer *reducer, Reduce_Stats *stats) {
+  if (args.engine->normalize == NULL) return reducer_normalize(reducer, args.budget, stats);
 
-    if (curr.src->left != NULL) {
-      if (!tree_add_left_child(curr.dst)) return false;
-      nob_da_append(&stack, ((Node_Pair){.dst = curr.dst->left, .src = curr.src->left}));
-    }
+  Tree_Node *tree = reducer->tree;
+  bool ok = args.engine->normalize(&reducer->generations[reducer->generation], &tree, args.budget, stats);
+  reducer_set_tree(reducer, tree);
+  return ok;
+}
 
-    if (curr.src->right != NULL) {
-      if (!tree_add_right_child(curr.dst)) return false;
-      nob_da_append(&stack, ((Node_Pair){.dst = curr.dst->right, .src = curr.src->right}));
-    }
+int normalize(Cli_Args args) {
+  Reducer reducer = {0};
+  if (!load_term(args, sv_from_cstr(args.term), &reducer)) return 1;
+  reducer.strategy = args.strategy;
+
+  Reduce_Stats stats = {0};
+  bool ok = run_engine(args, &reducer, &stats);
+  print_stats(stats);
+  if (graph_memo != NULL) {
+    printf("memo: %zu hits (%zu steps saved), %zu misses, %zu entries\n", graph_memo->hits, graph_memo->saved_steps,
+           graph_memo->misses, graph_memo->count);
   }
 
-  nob_da_free(stack);
+  if (ok) ok = print_term(args, reducer.tree);
 
-  return true;
+  reducer_free(&reducer);
+  return ok ? 0 : 1;
 }
 
-bool beta_reduce(Tree_Node **nnode, bool *reducible) {
-  Vec(Tree_Node*) stack = {0};
-  Vec(Tree_Node*) atoms = {0};
+/*
+ * A corpus file is mapped and its lines are handed out as slices of the mapping, so terms are parsed where they lie
+ * in the file, with no copy and no scan for a terminator. Streams that cannot be mapped (stdin, pipes) are read
+ * through one buffer reused for every line instead, so memory depends on the longest line rather than on the size
+ * of the corpus.
+ */
+#define CORPUS_READ_SIZE (64 * 1024)
 
-  Tree_Node *parent = NULL;
-  Tree_Node *node = *nnode;
-  nob_da_append(&stack, node);
-  while (stack.count > 0
-         && !(node->kind == LAMBDA_APPLICATION
-         && node->left != NULL
-         && node->left->kind == LAMBDA_ABSTRACTION)) {
-    parent = node;
-    node = stack.items[--stack.count];
-    if (node->left != NULL) nob_da_append(&stack, node->left);
-    if (node->right != NULL) nob_da_append(&stack, node->right);
+typedef struct {
+  FILE *file; // NULL once the corpus is mapped
+  const char *map;
+  size_t map_size;
+  Nob_String_Builder buffer;
+  const char *data; // map or buffer.items
+  size_t start, end; // the bytes of data not handed out yet
+  size_t searched; // bytes from start known to hold no newline
+  bool eof; // nothing left to read past end
+} Corpus_Reader;
+
+bool corpus_open(Corpus_Reader *reader, const char *path) {
+  *reader = (Corpus_Reader){.file = stdin};
+  if (strcmp(path, "-") != 0) reader->file = fopen(path, "rb");
+  if (reader->file == NULL) {
+    fprintf(stderr, "Could not open corpus %s: %s\n", path, strerror(errno));
+    return false;
   }
-  stack.count = 0;
 
-  if (node == NULL || node->kind == LAMBDA_ATOM) {
-    *reducible = false;
-    goto done;
-  }
+  // stdin redirected from a file is mapped just the same.
+  struct stat st;
+  if (fstat(fileno(reader->file), &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) return true;
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(reader->file), 0);
+  if (map == MAP_FAILED) return true; // read it like a stream
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  if (reader->file != stdin) fclose(reader->file);
+  reader->file = NULL;
+  reader->map = map;
+  reader->map_size = st.st_size;
+  reader->data = map;
+  reader->end = st.st_size;
+  reader->eof = true;
+  return true;
+}
 
-  *reducible = true;
-  nob_da_append(&stack, node->left);
-  while (stack.count > 0) {
-    Tree_Node *curr = stack.items[--stack.count];
+void corpus_close(Corpus_Reader *reader) {
+  if (reader->map != NULL) munmap((void *)reader->map, reader->map_size);
+  if (reader->file != NULL && reader->file != stdin) fclose(reader->file);
+  nob_sb_free(reader->buffer);
+}
 
-    if (curr->kind == LAMBDA_ATOM) {
-      nob_da_append(&atoms, curr);
+// Gives the next line without its newline (or "\r\n"); false at the end of the corpus or on a read error.
+bool corpus_next_line(Corpus_Reader *reader, String_View *line) {
+  for (;;) {
+    const char *data = reader->data + reader->start;
+    size_t available = reader->end - reader->start;
+    const char *newline = available > 0 ? memchr(data + reader->searched, '\n', available - reader->searched) : NULL;
+    if (newline != NULL || (reader->eof && available > 0)) {
+      size_t n = newline != NULL ? (size_t)(newline - data) : available;
+      reader->start += n + (newline != NULL);
+      reader->searched = 0;
+      if (n > 0 && data[n - 1] == '\r') n -= 1;
+      *line = sv_from_parts(data, n);
+      return true;
+    }
+    if (reader->eof) return false;
+
+    // Move what is left of the last line to the front of the buffer and read more after it.
+    if (available > 0) memmove(reader->buffer.items, data, available);
+    reader->start = 0;
+    reader->end = available;
+    reader->searched = available;
+    nob_da_reserve(&reader->buffer, reader->end + CORPUS_READ_SIZE);
+    reader->data = reader->buffer.items;
+    size_t n = fread(reader->buffer.items + reader->end, 1, CORPUS_READ_SIZE, reader->file);
+    reader->end += n;
+    if (n < CORPUS_READ_SIZE) {
+      if (ferror(reader->file)) {
+        fprintf(stderr, "Could not read corpus: %s\n", strerror(errno));
+        return false;
+      }
+      reader->eof = true;
     }
-
-    if (curr->left != NULL) nob_da_append(&stack, curr->left);
-    if (curr->right != NULL) nob_da_append(&stack, curr->right);
   }
-  stack.count = 0;
+}
 
-  Nob_String_Builder sb = {0};
-  nob_da_foreach(Tree_Node*, atom, &atoms) {
-    if (*atom == node->left->left) continue;
-    if ((*atom)->atom == node->left->left->atom) {
-      sb.count = 0;
-      tree_node_label(&sb, node->right);
-      printf("copy "SB_Fmt" to ", SB_Arg(sb));
-      sb.count = 0;
-      tree_node_label(&sb, *atom);
-      printf(SB_Fmt"\n", SB_Arg(sb));
-
-      if (!tree_copy_subtree_to_node(*atom, node->right)) return false;
+/*
+ * Streams a corpus, one term per line ('-' for stdin): parses each term, normalizes it if asked to, lays out its
+ * diagram and prints a line per term with the line number, the outcome and steps ("-" without `normalize`), the
+ * number of lines in the diagram, its size and the term in the output syntax. Empty lines are skipped, terms that
+ * fail to parse get an "error" line and the rest of the corpus is still processed. The reducer, the diagram and the
+ * symbol table are reused from term to term. With `diagram-memo` the term is laid out from a term store, through a
+ * memo of closed subterms' layouts that lives for the whole corpus.
+ */
+int corpus(Cli_Args args) {
+  Corpus_Reader reader;
+  if (!corpus_open(&reader, args.corpus)) return 1;
+
+  Reducer reducer = {0};
+  reducer.strategy = args.strategy;
+  Diagram diagram = {0};
+  Diagram_Memo diagram_memo = {0};
+  Term_Store store = {0};
+  Nob_String_Builder out = {0};
+  size_t terms = 0, failed = 0, line_number = 0;
+  double start = now_seconds();
+
+  String_View line;
+  while (corpus_next_line(&reader, &line)) {
+    line_number += 1;
+    if (line.count == 0) continue;
+    terms += 1;
+
+    // Names from earlier terms are dead, unless the memo holds normal forms that still use them.
+    if (graph_memo == NULL && symbols.names.count > 0) symbol_reset();
+
+    out.count = 0;
+    bool ok = load_term(args, line, &reducer);
+    Reduce_Stats stats = {0};
+    if (ok && args.normalize) ok = run_engine(args, &reducer, &stats);
+    if (ok && args.diagram_memo) {
+      Term_Index root;
+      store.count = 0;
+      ok = term_from_tree(&store, reducer.tree, &root);
+      if (ok) diagram_from_term(&diagram, &store, root, &diagram_memo);
+    } else if (ok) {
+      diagram_from_lambda_tree(&diagram, reducer.tree);
+    }
+    if (ok) {
+      if (args.normalize) {
+        nob_sb_appendf(&out, "%zu\t%s\t%zu", line_number, reduce_outcome_name(stats.outcome), stats.steps);
+      } else {
+        nob_sb_appendf(&out, "%zu\t-\t-", line_number);
+      }
+      nob_sb_appendf(&out, "\t%zu\t%" PRIu32 "x%" PRIu32 "\t", diagram_line_count(diagram), diagram.width,
+                     diagram.height);
+      ok = append_term(args, reducer.tree, &out);
     }
+    if (!ok) {
+      failed += 1;
+      out.count = 0;
+      nob_sb_appendf(&out, "%zu\terror", line_number);
+    }
+    printf(SB_Fmt "\n", SB_Arg(out));
   }
 
-  nob_sb_free(sb);
+  double seconds = now_seconds() - start;
+  fprintf(stderr, "%zu terms, %zu failed, %.3fs (%.0f terms/s)\n", terms, failed, seconds,
+          seconds > 0 ? terms / seconds : 0.0);
+  if (args.diagram_memo) {
+    fprintf(stderr, "diagram memo: %zu hits, %zu misses, %zu entries\n", diagram_memo.hits, diagram_memo.misses,
+            diagram_memo.count);
+  }
 
-  tree_free(node->right);
-  node->right = NULL;
+  bool ok = reader.eof && reader.start == reader.end;
+  corpus_close(&reader);
+  nob_sb_free(out);
+  nob_da_free(store);
+  diagram_memo_free(&diagram_memo);
+  diagram_free(&diagram);
+  reducer_free(&reducer);
+  return ok && failed == 0 ? 0 : 1;
+}
 
-  Tree_Node *new_node = node->left->right;
-  if (node->left != NULL) free(node->left);
-  if (parent != NULL) {
-    if (node == parent->left) parent->left = new_node;
-    else if (node == parent->right) parent->right = new_node;
-  } else {
-    // do not do this, instead I need to free node and
-    // point the user's pointer to new_node... cba
-    // *node = *new_node;
-    free(node);
-    *nnode = new_node;
+// A balanced tree of applications with `leaves` atoms, so the parser recurses only logarithmically deep.
+void bench_parse_term(Nob_String_Builder *sb, size_t leaves) {
+  if (leaves == 1) {
+    nob_da_append(sb, 'x');
+    return;
   }
+  nob_da_append(sb, '(');
+  bench_parse_term(sb, leaves / 2);
+  bench_parse_term(sb, leaves - leaves / 2);
+  nob_da_append(sb, ')');
+}
 
-done:
-  nob_da_free(stack);
-  nob_da_free(atoms);
-  return true;
+// Parses terms of doubling size up to `max_bytes`; the time per byte stays flat if parsing is linear.
+int bench_parse(size_t max_bytes) {
+  Nob_String_Builder sb = {0};
+  Arena arena = {0};
+  bool ok = true;
+
+  for (size_t size = 1024; size <= max_bytes && ok; size *= 2) {
+    sb.count = 0;
+    nob_sb_append_cstr(&sb, "(lx.");
+    bench_parse_term(&sb, size / 3); // a leaf and its share of the parens take about three bytes
+    nob_sb_append_cstr(&sb, ")");
+    nob_sb_append_null(&sb);
+    size_t len = sb.count - 1;
+
+    arena_reset(&arena);
+    double start = now_seconds();
+    Tree_Node *tree = tree_new_node(&arena);
+    ok = tree != NULL && tree_parse_lambda_term(&arena, tree, sv_from_parts(sb.items, len));
+    double tree_seconds = now_seconds() - start;
+
+    Term_Dag dag = {0};
+    Dag_Index root;
+    start = now_seconds();
+    ok = ok && dag_parse_lambda_term(&dag, sv_from_parts(sb.items, len), &root);
+    double dag_seconds = now_seconds() - start;
+    dag_free(&dag);
+
+    printf("%10zu bytes: tree %.3fs (%.1f ns/byte), dag %.3fs (%.1f ns/byte)\n", len, tree_seconds,
+           tree_seconds * 1e9 / len, dag_seconds, dag_seconds * 1e9 / len);
+  }
+
+  arena_free(&arena);
+  nob_sb_free(sb);
+  return ok ? 0 : 1;
 }
 
 int main(int argc, char **argv) {
-  (void)argc;
-  (void)argv;
+  Cli_Args args = {.engine = &engines[0]};
+  if (!parse_args(argc, argv, &args)) return 1;
+  if (args.bench_parse > 0) return bench_parse(args.bench_parse);
+
   // const char *term = "lf.lx.f(f(f(f(f(fx)))))";
   // const char *term = "ly.(lf.lx.f(f(f(f(f(fx))))))y";
   // const char *term = "(lx.xx)(lx.xx)";
@@ -160,16 +461,57 @@ int main(int argc, char **argv) {
   // const char *term = "ln.lf.lx.n(lg.lh.h(gf))(lu.x)(lu.u)";
   // const char *term = "lf.(lx.xx)(lx.f(xx))";
   // const char *term = "lf.(lx.xx)f";
+  if (args.corpus != NULL && args.term != NULL) {
+    fprintf(stderr, "A corpus brings its own terms, '%s' is one too many.\n", args.term);
+    return 1;
+  }
+  if (args.corpus == NULL && args.term == NULL && args.blc_input && args.blc_in == NULL) {
+    fprintf(stderr, "No BLC term given.\n");
+    return 1;
+  }
+  if (args.term == NULL) args.term = term;
+  // Only graph reduction looks subterms up in the memo, any other engine would silently ignore it.
+  if (args.memo && args.engine->normalize != graph_normalize_tree) {
+    fprintf(stderr, "memo and memo-file only work with engine sharing, not '%s'.\n", args.engine->name);
+    return 1;
+  }
+  // Likewise loop detection, which only the tree reducer does.
+  if (args.budget.detect_loops && args.engine->normalize != NULL) {
+    fprintf(stderr, "detect-loops only works with engine tree, not '%s'.\n", args.engine->name);
+    return 1;
+  }
+
+  Memo memo = {0};
+  if (args.memo_file != NULL && !memo_open(&memo, args.memo_file)) return 1;
+  if (args.memo) graph_memo = &memo;
+
+  if (args.corpus != NULL) {
+    if (args.blc_in != NULL || args.blc_out != NULL) {
+      fprintf(stderr, "blc-in and blc-out take a single term, not a corpus.\n");
+      return 1;
+    }
+    int status = corpus(args);
+    parallel_shutdown();
+    memo_free(&memo);
+    return status;
+  }
+
+  if (args.normalize) {
+    int status = normalize(args);
+    parallel_shutdown();
+    memo_free(&memo);
+    return status;
+  }
 
-  Tree_Node *tree = calloc(1, sizeof(Tree_Node));
-  assert(tree != NULL);
-  if (!tree_parse_lambda_term(tree, term)) return 1;
+  Reducer reducer = {0};
+  if (!load_term(args, sv_from_cstr(args.term), &reducer)) return 1;
+  reducer.strategy = args.strategy;
 
-  // tree_print_graphviz(stdout, tree, true);
+  // tree_print_graphviz(stdout, reducer.tree, true);
   // bool reducible;
-  // if (!beta_reduce(tree, &reducible)) return 1;
+  // if (!beta_reduce(&reducer, &reducible)) return 1;
   // if (!reducible) printf("IRREDUCIBLE!\n");
-  tree_print_graphviz(stdout, tree, true);
+  if (args.graphviz) tree_print_graphviz(stdout, reducer.tree, true);
 
   SetTraceLogLevel(LOG_ERROR);
   SetConfigFlags(FLAG_WINDOW_RESIZABLE);
@@ -178,7 +520,7 @@ int main(int argc, char **argv) {
   bool reducible = true;
   Diagram diagram = {0};
   RenderTexture2D texture = LoadRenderTexture(800, 600);
-  diagram_from_lambda_tree(&diagram, tree);
+  diagram_from_lambda_tree(&diagram, reducer.tree);
   diagram_to_raylib_texture(texture, diagram, 1, 0.0);
   while (!WindowShouldClose()) {
     BeginDrawing();
@@ -187,17 +529,28 @@ int main(int argc, char **argv) {
     EndDrawing();
 
     if (IsKeyPressed(KEY_SPACE)) {
-      if (reducible) { beta_reduce(&tree, &reducible); }
-      diagram.count = 0;
-      tree_print_graphviz(stdout, tree, true);
-      diagram_from_lambda_tree(&diagram, tree);
+      if (reducible && args.engine->normalize != NULL) {
+        Reduce_Stats stats;
+        Tree_Node *tree = reducer.tree;
+        if (!args.engine->normalize(&reducer.generations[reducer.generation], &tree, args.budget, &stats)) return 1;
+        reducer_set_tree(&reducer, tree);
+        print_stats(stats);
+        reducible = false;
+      } else if (reducible) {
+        if (!beta_reduce(&reducer, &reducible)) return 1;
+      }
+      if (args.graphviz) tree_print_graphviz(stdout, reducer.tree, true);
+      // After a single step only the contracted redex is laid out again, anything else starts from scratch.
+      diagram_relayout(&diagram, reducer.tree, reducer.contracted, reducer.contractum);
       diagram_to_raylib_texture(texture, diagram, 1, 0.0);
     }
   }
 
   CloseWindow();
 
-  nob_da_free(diagram);
-  tree_free(tree);
+  diagram_free(&diagram);
+  reducer_free(&reducer);
+  parallel_shutdown();
+  memo_free(&memo);
   return 0;
 }
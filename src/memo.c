@@ -0,0 +1,293 @@
+#include "memo.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nob.h>
+
+#define MEMO_INITIAL_CAPACITY 256
+#define MEMO_FILE_MAGIC_SIZE (sizeof(MEMO_FILE_MAGIC) - 1)
+
+static uint64_t memo_slot_hash(uint64_t hash) {
+  return hash != 0 ? hash : 1;
+}
+
+static Memo_Entry *memo_find(const Memo *memo, const Term_Store *store, Term_Index root, uint64_t hash) {
+  hash = memo_slot_hash(hash);
+  if (memo->capacity == 0) return NULL;
+
+  for (size_t i = hash & (memo->capacity - 1); memo->entries[i].hash != 0; i = (i + 1) & (memo->capacity - 1)) {
+    Memo_Entry *entry = &memo->entries[i];
+    if (entry->hash == hash && term_equal(&memo->terms, entry->key, store, root)) return entry;
+  }
+  return NULL;
+}
+
+bool memo_lookup(Memo *memo, const Term_Store *store, Term_Index root, uint64_t hash, Term_Index *normal_form) {
+  Memo_Entry *entry = memo_find(memo, store, root, hash);
+  if (entry == NULL) {
+    memo->misses += 1;
+    return false;
+  }
+
+  *normal_form = entry->normal_form;
+  memo->hits += 1;
+  memo->saved_steps += entry->steps;
+  return true;
+}
+
+static void memo_place(Memo_Entry *entries, size_t capacity, Memo_Entry entry) {
+  size_t i = entry.hash & (capacity - 1);
+  while (entries[i].hash != 0) i = (i + 1) & (capacity - 1);
+  entries[i] = entry;
+}
+
+static void memo_grow(Memo *memo) {
+  size_t capacity = memo->capacity > 0 ? memo->capacity * 2 : MEMO_INITIAL_CAPACITY;
+  Memo_Entry *entries = calloc(capacity, sizeof(Memo_Entry));
+  assert(entries != NULL && "Out of memory");
+
+  for (size_t i = 0; i < memo->capacity; ++i) {
+    if (memo->entries[i].hash != 0) memo_place(entries, capacity, memo->entries[i]);
+  }
+
+  free(memo->entries);
+  memo->entries = entries;
+  memo->capacity = capacity;
+}
+
+static void memo_add(Memo *memo, Memo_Entry entry) {
+  if (2 * (memo->count + 1) > memo->capacity) memo_grow(memo);
+  entry.hash = memo_slot_hash(entry.hash);
+  memo_place(memo->entries, memo->capacity, entry);
+  memo->count += 1;
+}
+
+// FNV-1a
+static uint64_t memo_checksum(Memo_Record record, const void *nodes, size_t size) {
+  record.checksum = 0;
+  uint64_t checksum = UINT64_C(0xcbf29ce484222325);
+  for (size_t i = 0; i < sizeof(record); ++i) {
+    checksum = (checksum ^ ((const unsigned char *)&record)[i]) * UINT64_C(0x100000001b3);
+  }
+  for (size_t i = 0; i < size; ++i) {
+    checksum = (checksum ^ ((const unsigned char *)nodes)[i]) * UINT64_C(0x100000001b3);
+  }
+  return checksum;
+}
+
+static void memo_append_record(Memo *memo, Term_Index key, Term_Index normal_form, uint64_t hash, size_t steps) {
+  Term_Index key_start = term_subterm_start(&memo->terms, key);
+  Term_Index normal_form_start = term_subterm_start(&memo->terms, normal_form);
+  Memo_Record record = {
+      .key_count = key - key_start + 1,
+      .normal_form_count = normal_form - normal_form_start + 1,
+      .hash = hash,
+      .steps = steps,
+  };
+
+  // The whole record goes out in one write, with its node indices made relative to each term's start and its
+  // interned names numbered in the order they come.
+  Nob_String_Builder buffer = {0};
+  Nob_String_Builder names = {0};
+  nob_da_reserve(&buffer, sizeof(Memo_Record) + (record.key_count + record.normal_form_count) * sizeof(Term_Node));
+  buffer.count = sizeof(Memo_Record);
+
+  Term_Index starts[] = {key_start, normal_form_start};
+  uint32_t counts[] = {record.key_count, record.normal_form_count};
+  uint32_t named = 0;
+  for (size_t term = 0; term < 2; ++term) {
+    for (uint32_t i = 0; i < counts[term]; ++i) {
+      Term_Node node = memo->terms.items[starts[term] + i];
+      if (term_kind(node) == LAMBDA_ABSTRACTION && term_data(node) >= SYMBOL_FIRST_INTERNED) {
+        String_View name = symbol_name(term_data(node));
+        nob_sb_append_buf(&names, name.data, name.count);
+        nob_da_append(&names, '\0');
+        node.head = ((SYMBOL_FIRST_INTERNED + named++) << TERM_KIND_BITS) | LAMBDA_ABSTRACTION;
+      }
+      if (node.left != TERM_NONE) node.left -= starts[term];
+      if (node.right != TERM_NONE) node.right -= starts[term];
+      nob_da_append_many(&buffer, &node, sizeof(node));
+    }
+  }
+  while (names.count % sizeof(uint32_t) != 0) nob_da_append(&names, '\0');
+  nob_da_append_many(&buffer, names.items, names.count);
+
+  record.names_size = names.count;
+  record.checksum = memo_checksum(record, buffer.items + sizeof(Memo_Record), buffer.count - sizeof(Memo_Record));
+  memcpy(buffer.items, &record, sizeof(Memo_Record));
+
+  if (fwrite(buffer.items, buffer.count, 1, memo->file) != 1 || fflush(memo->file) != 0) {
+    fprintf(stderr, "Could not write to the memo cache: %s\n", strerror(errno));
+    fclose(memo->file);
+    memo->file = NULL;
+  }
+  nob_sb_free(buffer);
+  nob_sb_free(names);
+}
+
+// `normal_form` must already be in memo->terms, the key is copied there from `store`.
+void memo_insert(Memo *memo, const Term_Store *store, Term_Index root, uint64_t hash, Term_Index normal_form,
+                 size_t steps) {
+  Term_Index key = term_copy(&memo->terms, store, root);
+  memo_add(memo, (Memo_Entry){.hash = hash, .key = key, .normal_form = normal_form, .steps = steps});
+  if (memo->file != NULL) memo_append_record(memo, key, normal_form, hash, steps);
+}
+
+typedef Vec(String_View) Memo_Names;
+
+// Appends `count` nodes of a record to the store, unless they do not spell out a single term.
+static bool memo_load_term(Term_Store *store, const Term_Node *nodes, uint32_t count, const Memo_Names *names,
+                           Term_Index *root) {
+  Term_Index base = (Term_Index)store->count;
+  nob_da_reserve(store, store->count + count);
+  for (uint32_t i = 0; i < count; ++i) {
+    Term_Node node = nodes[i];
+    bool valid;
+    switch (term_kind(node)) {
+    case LAMBDA_ATOM: valid = node.left == TERM_NONE && node.right == TERM_NONE; break;
+    case LAMBDA_ABSTRACTION: valid = node.left == TERM_NONE && node.right < i; break;
+    case LAMBDA_APPLICATION: valid = node.left < i && node.right < i; break;
+    default: valid = false; break;
+    }
+    if (!valid) return false;
+
+    if (term_kind(node) == LAMBDA_ABSTRACTION && term_data(node) >= SYMBOL_FIRST_INTERNED) {
+      size_t name = term_data(node) - SYMBOL_FIRST_INTERNED;
+      if (name >= names->count) return false;
+      node.head = (symbol_intern(names->items[name]) << TERM_KIND_BITS) | LAMBDA_ABSTRACTION;
+    }
+    if (node.left != TERM_NONE) node.left += base;
+    if (node.right != TERM_NONE) node.right += base;
+    store->items[store->count++] = node;
+  }
+
+  *root = (Term_Index)(store->count - 1);
+  return term_subterm_start(store, *root) == base;
+}
+
+// Loads the records of a cache file read into `data` and returns where the valid ones end.
+static size_t memo_load(Memo *memo, const char *data, size_t size) {
+  Memo_Names names = {0};
+  size_t offset = MEMO_FILE_MAGIC_SIZE;
+  while (size - offset >= sizeof(Memo_Record)) {
+    Memo_Record record;
+    memcpy(&record, data + offset, sizeof(Memo_Record));
+    if (record.key_count == 0 || record.normal_form_count == 0) break;
+
+    size_t count = (size_t)record.key_count + record.normal_form_count;
+    size_t left = size - offset - sizeof(Memo_Record);
+    if (count > left / sizeof(Term_Node) || record.names_size > left - count * sizeof(Term_Node)) break;
+    if (record.names_size % sizeof(uint32_t) != 0) break;
+    const Term_Node *nodes = (const Term_Node *)(data + offset + sizeof(Memo_Record));
+    size_t body = count * sizeof(Term_Node) + record.names_size;
+    if (memo_checksum(record, nodes, body) != record.checksum) break;
+
+    // NUL-terminated names, then the padding, which reads as empty ones.
+    names.count = 0;
+    const char *name = (const char *)(nodes + count);
+    const char *end = name + record.names_size;
+    while (name < end && *name != '\0') {
+      size_t length = strnlen(name, end - name);
+      nob_da_append(&names, sv_from_parts(name, length));
+      name += length + 1;
+    }
+
+    size_t mark = memo->terms.count;
+    Term_Index key, normal_form;
+    if (!memo_load_term(&memo->terms, nodes, record.key_count, &names, &key) ||
+        !memo_load_term(&memo->terms, nodes + record.key_count, record.normal_form_count, &names, &normal_form)) {
+      memo->terms.count = mark;
+      break;
+    }
+
+    // Two runs sharing a file can both append the same entry.
+    if (memo_find(memo, &memo->terms, key, record.hash) == NULL) {
+      memo_add(memo, (Memo_Entry){.hash = record.hash, .key = key, .normal_form = normal_form, .steps = record.steps});
+    } else {
+      memo->terms.count = mark;
+    }
+    offset += sizeof(Memo_Record) + body;
+  }
+
+  nob_da_free(names);
+  return offset;
+}
+
+/*
+ * Loads the entries of the cache file at `path` (creating it if needed) and appends every entry inserted from now
+ * on to it.
+ */
+bool memo_open(Memo *memo, const char *path) {
+  int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Could not open memo cache %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    fprintf(stderr, "Could not stat memo cache %s: %s\n", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  size_t size = (size_t)st.st_size;
+  Nob_String_Builder data = {0};
+  nob_da_reserve(&data, size);
+  while (data.count < size) {
+    ssize_t n = read(fd, data.items + data.count, size - data.count);
+    if (n <= 0) {
+      fprintf(stderr, "Could not read memo cache %s: %s\n", path, n < 0 ? strerror(errno) : "file shrank");
+      goto fail;
+    }
+    data.count += n;
+  }
+
+  if (size < MEMO_FILE_MAGIC_SIZE && (size == 0 || memcmp(data.items, MEMO_FILE_MAGIC, size) == 0)) {
+    // A new file, or one whose header a crash cut short, which holds no records yet.
+    if (size > 0) fprintf(stderr, "Rewriting the torn header of memo cache %s\n", path);
+    if (ftruncate(fd, 0) != 0 || write(fd, MEMO_FILE_MAGIC, MEMO_FILE_MAGIC_SIZE) != (ssize_t)MEMO_FILE_MAGIC_SIZE) {
+      fprintf(stderr, "Could not write to memo cache %s: %s\n", path, strerror(errno));
+      goto fail;
+    }
+  } else if (size < MEMO_FILE_MAGIC_SIZE || memcmp(data.items, MEMO_FILE_MAGIC, MEMO_FILE_MAGIC_SIZE) != 0) {
+    fprintf(stderr, "%s is not a memo cache, or one from another version\n", path);
+    goto fail;
+  } else {
+    size_t valid = memo_load(memo, data.items, size);
+    if (valid < size) {
+      fprintf(stderr, "Dropping %zu bytes of torn records at the end of memo cache %s\n", size - valid, path);
+      if (ftruncate(fd, (off_t)valid) != 0) {
+        fprintf(stderr, "Could not truncate memo cache %s: %s\n", path, strerror(errno));
+        goto fail;
+      }
+    }
+  }
+  nob_sb_free(data);
+
+  memo->file = fdopen(fd, "a");
+  if (memo->file == NULL) {
+    fprintf(stderr, "Could not open memo cache %s: %s\n", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+  return true;
+
+fail:
+  nob_sb_free(data);
+  close(fd);
+  return false;
+}
+
+void memo_free(Memo *memo) {
+  if (memo->file != NULL) fclose(memo->file);
+  nob_da_free(memo->terms);
+  free(memo->entries);
+  *memo = (Memo){0};
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "term.h"
+#include "util.h"
+
+/*
+ * Normal form memo table.
+ *
+ * Maps terms to their normal forms, keyed by term_hashes, which is alpha-invariant: whichever names a numeral or a
+ * combinator was written with, every occurrence lands on the same entry. Keys and normal forms are copied into the
+ * memo's own store, so the table outlives the terms it was filled from and can be shared by every reduction in a
+ * run. Hash collisions are told apart by comparing the keys (term_equal).
+ *
+ * Open addressing with linear probing, kept at most half full.
+ *
+ * A memo can be backed by a cache file (memo_open), so it also outlives the run. The file is append-only: a header,
+ * then one self-contained record per entry (see Memo_Record), written with a single write as soon as the entry is
+ * inserted. Opening reads the file and loads every record up to the first one that is cut short or fails its
+ * checksum, which is where a crash mid-write leaves the file; the torn tail is truncated away, and a file cut short
+ * inside the header starts over empty. Records hold the nodes as they are in memory, so a cache file is only meant
+ * to be read back on the machine that wrote it. Names longer than a character are interned per run (see symbol.h),
+ * so a record spells them out and they are interned again when it is loaded.
+ */
+
+typedef struct {
+  uint64_t hash; // 0 for an empty slot, hashes are made nonzero
+  Term_Index key; // in terms
+  Term_Index normal_form; // in terms
+  uint64_t steps; // beta steps it took to find the normal form
+} Memo_Entry;
+
+typedef struct {
+  Term_Store terms;
+  Memo_Entry *entries;
+  size_t capacity; // a power of two, or 0
+  size_t count;
+  size_t hits;
+  size_t misses;
+  size_t saved_steps; // steps of the entries that were hit
+  FILE *file; // cache file new entries are appended to, NULL for none
+} Memo;
+
+#define MEMO_FILE_MAGIC "TROMPNF2"
+
+/*
+ * Followed by key_count key nodes and normal_form_count normal form nodes, indices relative to each term's start,
+ * then names_size bytes of names. An abstraction named by an interned symbol holds SYMBOL_FIRST_INTERNED + i instead,
+ * for the i-th name, names being NUL-terminated and padded with NULs so the next record stays aligned.
+ */
+typedef struct {
+  uint32_t key_count;
+  uint32_t normal_form_count;
+  uint64_t names_size;
+  uint64_t hash;
+  uint64_t steps;
+  uint64_t checksum; // of the fields above and the nodes
+} Memo_Record;
+
+bool memo_open(Memo *memo, const char *path);
+bool memo_lookup(Memo *memo, const Term_Store *store, Term_Index root, uint64_t hash, Term_Index *normal_form);
+void memo_insert(Memo *memo, const Term_Store *store, Term_Index root, uint64_t hash, Term_Index normal_form,
+                 size_t steps);
+void memo_free(Memo *memo);
@@ -0,0 +1,269 @@
+#include "nbe.h"
+
+#include <assert.h>
+
+#include <nob.h>
+
+typedef struct Nbe_List Nbe_List;
+typedef struct Nbe_Thunk Nbe_Thunk;
+typedef struct Nbe_Value Nbe_Value;
+
+// Environments (innermost binding first) and neutral spines (last argument first) are both lists of thunks.
+struct Nbe_List {
+  Nbe_Thunk *thunk;
+  Nbe_List *next;
+};
+
+struct Nbe_Thunk {
+  Term_Index term;
+  Nbe_List *env;
+  Nbe_Value *value; // NULL until forced
+};
+
+struct Nbe_Value {
+  Term_Index abstraction; // closure: the abstraction node, TERM_NONE for a neutral value
+  uint32_t level; // neutral: how many abstractions of the normal form enclose the head variable's binder
+  Nbe_List *list; // closure: environment, neutral: spine
+};
+
+// A thunk being forced, with the arguments that wait for its value.
+typedef struct {
+  Nbe_Thunk *thunk;
+  Nbe_List *args;
+} Nbe_Force;
+
+typedef struct {
+  const Term_Store *store;
+  Arena arena;
+  size_t nodes;
+  Vec(Nbe_Force) forcing; // innermost last
+
+  Reduce_Budget budget;
+  Reduce_Stats *stats;
+  double start;
+  bool stopped;
+} Nbe;
+
+static void *nbe_alloc(Nbe *nbe, size_t size) {
+  void *ptr = arena_alloc(&nbe->arena, size);
+  assert(ptr != NULL && "Out of memory");
+  nbe->nodes += 1;
+  return ptr;
+}
+
+static Nbe_List *nbe_cons(Nbe *nbe, Nbe_Thunk *thunk, Nbe_List *next) {
+  Nbe_List *list = nbe_alloc(nbe, sizeof(Nbe_List));
+  *list = (Nbe_List){.thunk = thunk, .next = next};
+  return list;
+}
+
+static Nbe_Thunk *nbe_delay(Nbe *nbe, Term_Index term, Nbe_List *env) {
+  Nbe_Thunk *thunk = nbe_alloc(nbe, sizeof(Nbe_Thunk));
+  *thunk = (Nbe_Thunk){.term = term, .env = env};
+  return thunk;
+}
+
+static Nbe_Value *nbe_value(Nbe *nbe, Term_Index abstraction, uint32_t level, Nbe_List *list) {
+  Nbe_Value *value = nbe_alloc(nbe, sizeof(Nbe_Value));
+  *value = (Nbe_Value){.abstraction = abstraction, .level = level, .list = list};
+  return value;
+}
+
+/*
+ * Evaluates `term` in `env`. The application spine is walked iteratively and closures are entered in a loop, and a
+ * variable whose thunk has not been forced yet does not recurse either: the thunk goes on the forcing stack with the
+ * arguments waiting for it, its term is evaluated in their place, and the value comes back to it, then to them.
+ * Returns NULL once the budget has run out.
+ */
+static Nbe_Value *nbe_eval(Nbe *nbe, Term_Index term, Nbe_List *env) {
+  Nbe_List *args = NULL; // first argument on top
+  size_t base = nbe->forcing.count;
+
+  for (;;) {
+    Term_Node node = nbe->store->items[term];
+    if (term_kind(node) == LAMBDA_APPLICATION) {
+      args = nbe_cons(nbe, nbe_delay(nbe, node.right, env), args);
+      term = node.left;
+      continue;
+    }
+
+    if (term_kind(node) == LAMBDA_ABSTRACTION && args != NULL) {
+      Reduce_Stats *stats = nbe->stats;
+      if (reduce_budget_exhausted(nbe->budget, stats->steps, nbe->nodes, nbe->start, &stats->outcome)) {
+        nbe->stopped = true;
+        nbe->forcing.count = base;
+        return NULL;
+      }
+      env = nbe_cons(nbe, args->thunk, env);
+      args = args->next;
+      term = node.right;
+      stats->steps += 1;
+      continue;
+    }
+
+    Nbe_Value *value;
+    if (term_kind(node) == LAMBDA_ABSTRACTION) {
+      value = nbe_value(nbe, term, 0, env);
+    } else {
+      Nbe_List *binding = env;
+      for (uint32_t i = term_data(node); i > 0; --i) binding = binding->next;
+      assert(binding != NULL && "Open term");
+
+      Nbe_Thunk *thunk = binding->thunk;
+      if (thunk->value == NULL) {
+        nob_da_append(&nbe->forcing, ((Nbe_Force){.thunk = thunk, .args = args}));
+        term = thunk->term;
+        env = thunk->env;
+        args = NULL;
+        continue;
+      }
+      value = thunk->value;
+    }
+
+    // Hand the value to the arguments waiting for it, and once there are none, to the thunk being forced.
+    for (;;) {
+      if (args != NULL && value->abstraction != TERM_NONE) break;
+      if (args != NULL) {
+        // A neutral value applied to more arguments stays neutral, with a longer spine.
+        Nbe_List *spine = value->list;
+        for (; args != NULL; args = args->next) spine = nbe_cons(nbe, args->thunk, spine);
+        value = nbe_value(nbe, TERM_NONE, value->level, spine);
+      }
+      if (nbe->forcing.count == base) return value;
+
+      Nbe_Force force = nbe->forcing.items[--nbe->forcing.count];
+      force.thunk->value = value;
+      force.thunk->env = NULL;
+      args = force.args;
+    }
+
+    // Applying a closure: carry on with its body and the remaining arguments.
+    term = value->abstraction;
+    env = value->list;
+  }
+}
+
+static Nbe_Value *nbe_force(Nbe *nbe, Nbe_Thunk *thunk) {
+  if (thunk->value == NULL) {
+    thunk->value = nbe_eval(nbe, thunk->term, thunk->env);
+    if (thunk->value != NULL) thunk->env = NULL;
+  }
+  return thunk->value;
+}
+
+/*
+ * Readback works like the Krivine machine's: an explicit task stack, results pushed to the store in postorder with
+ * the head variable of a neutral written first and each argument applied as soon as it has been read back.
+ */
+typedef enum {
+  NBE_TASK_QUOTE, // read back the value of `thunk` under `depth` abstractions
+  NBE_TASK_ABSTRACTION,
+  NBE_TASK_APPLICATION,
+} Nbe_Task_Kind;
+
+typedef struct {
+  Nbe_Task_Kind kind;
+  uint32_t depth;
+  Symbol name;
+  Nbe_Thunk *thunk;
+} Nbe_Task;
+
+bool nbe_normalize(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *result,
+                   Reduce_Budget budget, Reduce_Stats *stats) {
+  Nbe nbe = {.store = src, .budget = budget, .stats = stats, .start = now_seconds()};
+  *stats = (Reduce_Stats){.outcome = REDUCE_NORMAL_FORM};
+
+  Vec(Nbe_Task) tasks = {0};
+  Vec(Term_Index) results = {0};
+  Vec(Nbe_Thunk *) args = {0};
+  bool ok = true;
+
+  nob_da_append(&tasks, ((Nbe_Task){.kind = NBE_TASK_QUOTE, .thunk = nbe_delay(&nbe, root, NULL)}));
+  while (tasks.count > 0) {
+    Nbe_Task task = tasks.items[--tasks.count];
+
+    switch (task.kind) {
+    case NBE_TASK_QUOTE: {
+      Nbe_Value *value = nbe_force(&nbe, task.thunk);
+      if (value == NULL) {
+        ok = false;
+        goto done;
+      }
+
+      if (value->abstraction != TERM_NONE) {
+        Term_Node node = src->items[value->abstraction];
+        Nbe_Thunk *fresh = nbe_delay(&nbe, TERM_NONE, NULL);
+        fresh->value = nbe_value(&nbe, TERM_NONE, task.depth, NULL);
+        Nbe_Thunk *body = nbe_delay(&nbe, node.right, nbe_cons(&nbe, fresh, value->list));
+
+        nob_da_append(&tasks, ((Nbe_Task){.kind = NBE_TASK_ABSTRACTION, .name = term_data(node)}));
+        nob_da_append(&tasks, ((Nbe_Task){.kind = NBE_TASK_QUOTE, .depth = task.depth + 1, .thunk = body}));
+        break;
+      }
+
+      nob_da_append(&results, term_push_atom(dst, task.depth - 1 - value->level));
+
+      // The spine is last argument first, which is the order the tasks have to be pushed in.
+      args.count = 0;
+      for (Nbe_List *arg = value->list; arg != NULL; arg = arg->next) nob_da_append(&args, arg->thunk);
+      for (size_t i = 0; i < args.count; ++i) {
+        nob_da_append(&tasks, ((Nbe_Task){.kind = NBE_TASK_APPLICATION}));
+        nob_da_append(&tasks, ((Nbe_Task){.kind = NBE_TASK_QUOTE, .depth = task.depth, .thunk = args.items[i]}));
+      }
+    } break;
+
+    case NBE_TASK_ABSTRACTION: {
+      Term_Index body = results.items[--results.count];
+      nob_da_append(&results, term_push_abstraction(dst, task.name, body));
+    } break;
+
+    case NBE_TASK_APPLICATION: {
+      Term_Index argument = results.items[--results.count];
+      Term_Index function = results.items[--results.count];
+      nob_da_append(&results, term_push_application(dst, function, argument));
+    } break;
+    }
+  }
+
+  assert(results.count == 1);
+  *result = results.items[0];
+  stats->nodes = *result - term_subterm_start(dst, *result) + 1;
+
+done:
+  stats->peak_nodes = nbe.nodes;
+  stats->seconds = now_seconds() - nbe.start;
+  arena_free(&nbe.arena);
+  nob_da_free(nbe.forcing);
+  nob_da_free(tasks);
+  nob_da_free(results);
+  nob_da_free(args);
+  return ok;
+}
+
+bool nbe_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats) {
+  Term_Store src = {0};
+  Term_Store dst = {0};
+  *stats = (Reduce_Stats){.outcome = REDUCE_ERROR};
+  bool ok = false;
+
+  Term_Index root, result;
+  if (!term_from_tree(&src, *tree, &root)) goto done;
+  if (!nbe_normalize(&dst, &src, root, &result, budget, stats)) {
+    ok = stats->outcome != REDUCE_ERROR;
+    goto done;
+  }
+
+  Tree_Node *node = tree_new_node(arena);
+  if (node == NULL || !term_to_tree(arena, node, &dst, result)) {
+    stats->outcome = REDUCE_ERROR;
+    goto done;
+  }
+  tree_discard(arena, *tree);
+  *tree = node;
+  ok = true;
+
+done:
+  nob_da_free(src);
+  nob_da_free(dst);
+  return ok;
+}
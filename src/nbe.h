@@ -0,0 +1,23 @@
+#pragma once
+
+#include "parser.h"
+#include "reduce.h"
+#include "term.h"
+#include "util.h"
+
+/*
+ * Normalization by evaluation.
+ *
+ * A term is evaluated into a semantic domain where an abstraction is a closure (its body plus the environment it
+ * was built in) and a stuck computation is a neutral value (a variable applied to a spine of arguments). The
+ * environment binds variables to thunks that are evaluated at most once, so arguments are shared. The normal form
+ * is then read back from the value: under a closure we apply it to a fresh neutral variable and keep going, for a
+ * neutral we read back its arguments. Only the normal form is built, none of the intermediate terms.
+ *
+ * Steps count closure applications, nodes count the values, thunks and list cells allocated. If the budget runs
+ * out there is no result, nbe_normalize returns false and nbe_normalize_tree leaves the tree unchanged.
+ */
+
+bool nbe_normalize(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *result,
+                   Reduce_Budget budget, Reduce_Stats *stats);
+bool nbe_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats);
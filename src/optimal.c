@@ -0,0 +1,678 @@
+#include "optimal.h"
+
+#include <assert.h>
+
+#include <nob.h>
+
+typedef enum {
+  OPTIMAL_ROOT, // slot 1 holds the term, slot 0 is unused so the root never takes part in an interaction
+  OPTIMAL_LAMBDA, // slot 1: body, slot 2: binder
+  OPTIMAL_APPLICATION, // slot 0: function, slot 1: result, slot 2: argument
+  OPTIMAL_FAN,
+  OPTIMAL_CROISSANT,
+  OPTIMAL_BRACKET,
+  OPTIMAL_ERASER,
+} Optimal_Kind;
+
+static const uint32_t optimal_arity[] = {
+    [OPTIMAL_ROOT] = 1,    [OPTIMAL_LAMBDA] = 2,  [OPTIMAL_APPLICATION] = 2, [OPTIMAL_FAN] = 2,
+    [OPTIMAL_CROISSANT] = 1, [OPTIMAL_BRACKET] = 1, [OPTIMAL_ERASER] = 0,
+};
+
+// A port is a node index and a slot, slot 0 being the principal port.
+typedef uint32_t Optimal_Port;
+#define OPTIMAL_NONE ((Optimal_Port)UINT32_MAX)
+#define optimal_port(node, slot) ((Optimal_Port)((node) << 2 | (slot)))
+#define optimal_port_node(port) ((port) >> 2)
+#define optimal_port_slot(port) ((port) & 3)
+
+typedef struct {
+  uint8_t kind; // Optimal_Kind
+  Symbol name; // OPTIMAL_LAMBDA: name of the bound atom
+  uint32_t level;
+  Optimal_Port ports[3]; // what each slot is wired to
+} Optimal_Node;
+
+typedef struct {
+  Vec(Optimal_Node) nodes; // indices are stable, freed nodes are reused through `free`
+  Vec(uint32_t) free;
+  Vec(Optimal_Port) path; // optimal_whnf's stack of ports it has walked out of
+  size_t live;
+  size_t interactions;
+
+  Reduce_Budget budget;
+  Reduce_Stats *stats;
+  double start;
+} Optimal;
+
+static uint32_t optimal_node(Optimal *net, Optimal_Kind kind, uint32_t level, Symbol name) {
+  Optimal_Node node = {.kind = kind, .name = name, .level = level, .ports = {OPTIMAL_NONE, OPTIMAL_NONE, OPTIMAL_NONE}};
+  uint32_t index;
+  if (net->free.count > 0) {
+    index = net->free.items[--net->free.count];
+    net->nodes.items[index] = node;
+  } else {
+    index = net->nodes.count;
+    nob_da_append(&net->nodes, node);
+  }
+
+  net->live += 1;
+  net->stats->peak_nodes = max(net->stats->peak_nodes, net->live);
+  return index;
+}
+
+static void optimal_release(Optimal *net, uint32_t node) {
+  nob_da_append(&net->free, node);
+  net->live -= 1;
+}
+
+static inline Optimal_Port optimal_partner(const Optimal *net, Optimal_Port port) {
+  return net->nodes.items[optimal_port_node(port)].ports[optimal_port_slot(port)];
+}
+
+static inline void optimal_link(Optimal *net, Optimal_Port a, Optimal_Port b) {
+  net->nodes.items[optimal_port_node(a)].ports[optimal_port_slot(a)] = b;
+  net->nodes.items[optimal_port_node(b)].ports[optimal_port_slot(b)] = a;
+}
+
+/*
+ * Translation. A term at level n becomes:
+ * - an atom: a croissant of level n, principal port towards the binder;
+ * - an abstraction: a lambda of level n, its binder joined to the occurrences by a tree of fans of level n (or an
+ *   eraser if there are none);
+ * - an application: an application of level n whose argument is translated at level n + 1. Each occurrence in the
+ *   argument that is bound outside of it leaves through a bracket of level n.
+ *
+ * The store is in postorder, so the levels are assigned walking it backwards and the nodes built walking it
+ * forwards. The occurrences that are still unbound form a stack, each subterm owning a contiguous run of it.
+ *
+ * An atom gets a bracket for every argument between it and its binder, which is quadratic in the depth of a term
+ * like f(f(...(f x))), so the backward walk also counts the brackets and a net that would not fit in the budget, or
+ * in a port, is never built.
+ */
+#define OPTIMAL_MAX_NODES (UINT32_MAX >> 2) // a port keeps the node index in its upper 30 bits
+
+typedef struct {
+  uint32_t level;
+  uint32_t depth; // abstractions enclosing the subterm
+  uint32_t start; // first of the subterm's unbound occurrences
+  Optimal_Port out; // the port the subterm's parent connects to
+} Optimal_Translation;
+
+typedef struct {
+  Optimal_Port port;
+  uint32_t index; // de Bruijn index at the subterm being translated
+} Optimal_Occurrence;
+
+// Returns false, with the outcome set, if the term is not closed or its net would be too big.
+static bool optimal_from_term(Optimal *net, const Term_Store *store, Term_Index root, uint32_t *root_node) {
+  Term_Index base = term_subterm_start(store, root);
+  size_t count = root - base + 1;
+  Optimal_Translation *translation = malloc(count * sizeof(Optimal_Translation));
+  assert(translation != NULL && "Out of memory");
+  Vec(Optimal_Occurrence) occurrences = {0};
+  Vec(uint32_t) binder_levels = {0}; // by depth, of the abstraction at that depth on the path walked
+  bool ok = false;
+
+  // Walking a postorder store backwards visits every node after its parent, so the abstraction last seen at a depth
+  // is the one enclosing the nodes below it.
+  size_t brackets = 0;
+  translation[root - base].level = 0;
+  translation[root - base].depth = 0;
+  for (Term_Index i = root + 1; i-- > base;) {
+    Term_Node node = store->items[i];
+    uint32_t level = translation[i - base].level;
+    uint32_t depth = translation[i - base].depth;
+    if (term_kind(node) == LAMBDA_APPLICATION) {
+      translation[node.left - base] = (Optimal_Translation){.level = level, .depth = depth};
+      translation[node.right - base] = (Optimal_Translation){.level = level + 1, .depth = depth};
+    } else if (term_kind(node) == LAMBDA_ABSTRACTION) {
+      binder_levels.count = depth;
+      nob_da_append(&binder_levels, level);
+      translation[node.right - base] = (Optimal_Translation){.level = level, .depth = depth + 1};
+    } else if (term_data(node) >= depth) {
+      net->stats->outcome = REDUCE_ERROR;
+      goto done;
+    } else {
+      brackets += level - binder_levels.items[depth - 1 - term_data(node)];
+    }
+  }
+
+  // Every node of the term and every bracket is a node of the net, fans and erasers come on top.
+  size_t nodes = count + brackets + 1;
+  net->stats->peak_nodes = nodes;
+  if ((net->budget.max_nodes != 0 && nodes > net->budget.max_nodes) || nodes + count > OPTIMAL_MAX_NODES) {
+    net->stats->outcome = REDUCE_NODE_LIMIT;
+    goto done;
+  }
+
+  for (Term_Index i = base; i <= root; ++i) {
+    Term_Node node = store->items[i];
+    Optimal_Translation *t = &translation[i - base];
+
+    switch (term_kind(node)) {
+    case LAMBDA_ATOM: {
+      uint32_t croissant = optimal_node(net, OPTIMAL_CROISSANT, t->level, 0);
+      t->start = occurrences.count;
+      t->out = optimal_port(croissant, 1);
+      nob_da_append(&occurrences, ((Optimal_Occurrence){optimal_port(croissant, 0), term_data(node)}));
+    } break;
+
+    case LAMBDA_APPLICATION: {
+      const Optimal_Translation *function = &translation[node.left - base];
+      const Optimal_Translation *argument = &translation[node.right - base];
+      uint32_t application = optimal_node(net, OPTIMAL_APPLICATION, t->level, 0);
+      optimal_link(net, optimal_port(application, 0), function->out);
+      optimal_link(net, optimal_port(application, 2), argument->out);
+
+      for (size_t j = argument->start; j < occurrences.count; ++j) {
+        uint32_t bracket = optimal_node(net, OPTIMAL_BRACKET, t->level, 0);
+        optimal_link(net, optimal_port(bracket, 1), occurrences.items[j].port);
+        occurrences.items[j].port = optimal_port(bracket, 0);
+      }
+
+      t->start = function->start;
+      t->out = optimal_port(application, 1);
+    } break;
+
+    case LAMBDA_ABSTRACTION: {
+      const Optimal_Translation *body = &translation[node.right - base];
+      uint32_t lambda = optimal_node(net, OPTIMAL_LAMBDA, t->level, term_data(node));
+      optimal_link(net, optimal_port(lambda, 1), body->out);
+
+      // Occurrences of this binder are wired up, the others are kept with their index shifted down.
+      Optimal_Port binder = optimal_port(lambda, 2);
+      bool bound = false;
+      size_t kept = body->start;
+      for (size_t j = body->start; j < occurrences.count; ++j) {
+        Optimal_Occurrence occurrence = occurrences.items[j];
+        if (occurrence.index > 0) {
+          occurrences.items[kept++] = (Optimal_Occurrence){occurrence.port, occurrence.index - 1};
+          continue;
+        }
+
+        if (bound) {
+          // Another occurrence: put a fan where the previous one was connected.
+          Optimal_Port previous = optimal_partner(net, binder);
+          uint32_t fan = optimal_node(net, OPTIMAL_FAN, t->level, 0);
+          optimal_link(net, binder, optimal_port(fan, 0));
+          optimal_link(net, optimal_port(fan, 1), previous);
+          binder = optimal_port(fan, 2);
+        }
+        optimal_link(net, binder, occurrence.port);
+        bound = true;
+      }
+      occurrences.count = kept;
+
+      if (!bound) {
+        uint32_t eraser = optimal_node(net, OPTIMAL_ERASER, t->level, 0);
+        optimal_link(net, binder, optimal_port(eraser, 0));
+      }
+
+      t->start = body->start;
+      t->out = optimal_port(lambda, 0);
+    } break;
+    }
+  }
+
+  assert(occurrences.count == 0);
+  *root_node = optimal_node(net, OPTIMAL_ROOT, 0, 0);
+  optimal_link(net, optimal_port(*root_node, 1), translation[root - base].out);
+  ok = true;
+
+done:
+  free(translation);
+  nob_da_free(occurrences);
+  nob_da_free(binder_levels);
+  return ok;
+}
+
+/*
+ * Bookkeeping interactions can outnumber beta steps by far, so the node and time limits are checked on every
+ * interaction. The step limit only counts beta.
+ */
+static bool optimal_exhausted(Optimal *net) {
+  Reduce_Budget budget = net->budget;
+  net->interactions += 1;
+
+  // An interaction makes at most four nodes, which have to stay addressable by a port.
+  if ((budget.max_nodes != 0 && net->live > budget.max_nodes) || net->nodes.count + 4 > OPTIMAL_MAX_NODES) {
+    net->stats->outcome = REDUCE_NODE_LIMIT;
+    return true;
+  }
+
+  if (budget.max_seconds > 0 && net->interactions % REDUCE_CLOCK_INTERVAL == 0 &&
+      now_seconds() - net->start > budget.max_seconds) {
+    net->stats->outcome = REDUCE_TIME_LIMIT;
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * Rewrites the active pair `a`, `b`. Wires are relinked one at a time, each reading the partner as it is at that
+ * moment, so a wire between two ports of the pair itself is followed through instead of dangling. Returns false if
+ * the pair cannot occur in a net translated from a term.
+ */
+static bool optimal_interact(Optimal *net, uint32_t a, uint32_t b) {
+  if (optimal_exhausted(net)) return false;
+
+  Optimal_Node x = net->nodes.items[a];
+  Optimal_Node y = net->nodes.items[b];
+
+  if (x.kind == OPTIMAL_ERASER || y.kind == OPTIMAL_ERASER) {
+    uint32_t other = x.kind == OPTIMAL_ERASER ? b : a;
+    Optimal_Kind kind = net->nodes.items[other].kind;
+    for (uint32_t slot = 1; slot <= optimal_arity[kind]; ++slot) {
+      uint32_t eraser = optimal_node(net, OPTIMAL_ERASER, 0, 0);
+      optimal_link(net, optimal_port(eraser, 0), optimal_partner(net, optimal_port(other, slot)));
+    }
+  } else if ((x.kind == OPTIMAL_LAMBDA && y.kind == OPTIMAL_APPLICATION) ||
+             (x.kind == OPTIMAL_APPLICATION && y.kind == OPTIMAL_LAMBDA)) {
+    uint32_t lambda = x.kind == OPTIMAL_LAMBDA ? a : b;
+    uint32_t application = x.kind == OPTIMAL_LAMBDA ? b : a;
+
+    Reduce_Stats *stats = net->stats;
+    if (net->budget.max_steps != 0 && stats->steps >= net->budget.max_steps) {
+      stats->outcome = REDUCE_STEP_LIMIT;
+      return false;
+    }
+    stats->steps += 1;
+
+    // Result to body and argument to binder: the slots line up.
+    for (uint32_t slot = 1; slot <= 2; ++slot) {
+      optimal_link(net, optimal_partner(net, optimal_port(application, slot)),
+                   optimal_partner(net, optimal_port(lambda, slot)));
+    }
+  } else if (x.kind == y.kind && x.level == y.level) {
+    if (x.kind == OPTIMAL_LAMBDA || x.kind == OPTIMAL_APPLICATION) goto invalid;
+    for (uint32_t slot = 1; slot <= optimal_arity[x.kind]; ++slot) {
+      optimal_link(net, optimal_partner(net, optimal_port(a, slot)), optimal_partner(net, optimal_port(b, slot)));
+    }
+  } else {
+    // The node of the lower level passes through the other one; abstractions and applications never do.
+    bool x_passive = x.kind == OPTIMAL_LAMBDA || x.kind == OPTIMAL_APPLICATION;
+    bool y_passive = y.kind == OPTIMAL_LAMBDA || y.kind == OPTIMAL_APPLICATION;
+    if (x_passive && y_passive) goto invalid;
+
+    bool x_acts = y_passive || (!x_passive && x.level < y.level);
+    uint32_t active = x_acts ? a : b;
+    uint32_t passive = x_acts ? b : a;
+    Optimal_Node acting = x_acts ? x : y;
+    Optimal_Node moved = x_acts ? y : x;
+    if (acting.level >= moved.level) goto invalid;
+
+    uint32_t level = moved.level;
+    if (acting.kind == OPTIMAL_CROISSANT) level -= 1;
+    if (acting.kind == OPTIMAL_BRACKET) level += 1;
+
+    // One copy of the moved node on each auxiliary port of the acting one and vice versa, wired to each other.
+    uint32_t moved_copies[2], acting_copies[2];
+    uint32_t acting_arity = optimal_arity[acting.kind];
+    uint32_t moved_arity = optimal_arity[moved.kind];
+    for (uint32_t i = 0; i < acting_arity; ++i) moved_copies[i] = optimal_node(net, moved.kind, level, moved.name);
+    for (uint32_t j = 0; j < moved_arity; ++j) {
+      acting_copies[j] = optimal_node(net, acting.kind, acting.level, acting.name);
+    }
+    for (uint32_t i = 0; i < acting_arity; ++i) {
+      for (uint32_t j = 0; j < moved_arity; ++j) {
+        optimal_link(net, optimal_port(moved_copies[i], j + 1), optimal_port(acting_copies[j], i + 1));
+      }
+    }
+
+    for (uint32_t i = 0; i < acting_arity; ++i) {
+      optimal_link(net, optimal_port(moved_copies[i], 0), optimal_partner(net, optimal_port(active, i + 1)));
+    }
+    for (uint32_t j = 0; j < moved_arity; ++j) {
+      optimal_link(net, optimal_port(acting_copies[j], 0), optimal_partner(net, optimal_port(passive, j + 1)));
+    }
+  }
+
+  optimal_release(net, a);
+  optimal_release(net, b);
+  return true;
+
+invalid:
+  net->stats->outcome = REDUCE_ERROR;
+  return false;
+}
+
+/*
+ * Reduces the net until the port `from` (an auxiliary or root port) faces a node that is stuck: the walk leaves
+ * every node it enters through an auxiliary port by its principal port, and whenever that runs into another
+ * principal port the pair is rewritten and the walk backs up one node. It stops at a principal port facing an
+ * auxiliary one, or at the binder of an abstraction. Returns false if the budget ran out or the net was invalid.
+ */
+static bool optimal_whnf(Optimal *net, Optimal_Port from) {
+  net->path.count = 0;
+
+  for (;;) {
+    Optimal_Port to = optimal_partner(net, from);
+    uint32_t node = optimal_port_node(to);
+
+    if (optimal_port_slot(to) != 0) {
+      Optimal_Kind kind = net->nodes.items[node].kind;
+      if (kind == OPTIMAL_LAMBDA || kind == OPTIMAL_ROOT) return true;
+      nob_da_append(&net->path, from);
+      from = optimal_port(node, 0);
+      continue;
+    }
+
+    if (optimal_port_slot(from) != 0) return true;
+    if (!optimal_interact(net, optimal_port_node(from), node)) return false;
+    from = net->path.items[--net->path.count];
+  }
+}
+
+/*
+ * Readback context: one stack per level, recording which auxiliary port each fan on that level was entered from so
+ * the matching fan entered through its principal port can send the walk back the same way. A croissant inserts a
+ * level and a bracket merges two levels into a pair, exactly mirroring what they do to the levels of the nodes
+ * that pass through them.
+ *
+ * Contexts are persistent, since the readback keeps the one at every argument it leaves for later, and the levels
+ * are a zipper around a finger: the levels below it, nearest first, and the ones from it up. The walk crosses nodes
+ * at nearby levels one after the other (a run of brackets out of an argument goes down one level at a time), so
+ * moving the finger to the level of the next node costs a cell or two, where copying every level below it would
+ * cost one per level.
+ */
+typedef enum {
+  OPTIMAL_TOKEN_SQUARE, // a level opened by a croissant
+  OPTIMAL_TOKEN_LEFT, // fan entered from slot 1
+  OPTIMAL_TOKEN_RIGHT, // fan entered from slot 2
+  OPTIMAL_TOKEN_PAIR, // two levels merged by a bracket
+} Optimal_Token;
+
+typedef struct Optimal_Stack Optimal_Stack;
+struct Optimal_Stack {
+  Optimal_Token token;
+  Optimal_Stack *left, *right; // OPTIMAL_TOKEN_PAIR
+  Optimal_Stack *next;
+};
+
+typedef struct Optimal_Level {
+  Optimal_Stack *stack;
+  struct Optimal_Level *next;
+} Optimal_Level;
+
+// Levels past the end of `above` are empty stacks, `below` always holds `finger` levels.
+typedef struct {
+  Optimal_Level *below; // levels finger - 1 down to 0
+  Optimal_Level *above; // levels finger and up
+  uint32_t finger;
+} Optimal_Context;
+
+/*
+ * The same abstraction node can stand for several nested abstractions of the result, one per copy of a shared
+ * subgraph. The copy is told apart by the context below the abstraction's level, which is the same at its binder
+ * as it was at its principal port.
+ */
+typedef struct Optimal_Binders {
+  uint32_t lambda;
+  Optimal_Context context; // at the abstraction's principal port
+  struct Optimal_Binders *next;
+} Optimal_Binders;
+
+static Optimal_Stack *optimal_stack(Arena *arena, Optimal_Token token, Optimal_Stack *next) {
+  Optimal_Stack *stack = arena_alloc(arena, sizeof(Optimal_Stack));
+  assert(stack != NULL && "Out of memory");
+  *stack = (Optimal_Stack){.token = token, .next = next};
+  return stack;
+}
+
+static Optimal_Level *optimal_level(Arena *arena, Optimal_Stack *stack, Optimal_Level *next) {
+  Optimal_Level *level = arena_alloc(arena, sizeof(Optimal_Level));
+  assert(level != NULL && "Out of memory");
+  *level = (Optimal_Level){.stack = stack, .next = next};
+  return level;
+}
+
+// Moves the finger to `level`, one level at a time.
+static void optimal_context_seek(Arena *arena, Optimal_Context *context, uint32_t level) {
+  while (context->finger < level) {
+    Optimal_Level *above = context->above;
+    context->below = optimal_level(arena, above == NULL ? NULL : above->stack, context->below);
+    context->above = above == NULL ? NULL : above->next;
+    context->finger += 1;
+  }
+  while (context->finger > level) {
+    Optimal_Level *below = context->below;
+    // Empty levels at the top are left out, like the ones past the end.
+    if (context->above != NULL || below->stack != NULL) {
+      context->above = optimal_level(arena, below->stack, context->above);
+    }
+    context->below = below->next;
+    context->finger -= 1;
+  }
+}
+
+// The stack `offset` levels above the finger.
+static Optimal_Stack *optimal_context_at(const Optimal_Context *context, uint32_t offset) {
+  const Optimal_Level *level = context->above;
+  for (; level != NULL && offset > 0; --offset) level = level->next;
+  return level == NULL ? NULL : level->stack;
+}
+
+// Replaces `removed` levels starting at the finger with the `inserted` ones.
+static void optimal_context_splice(Arena *arena, Optimal_Context *context, uint32_t removed,
+                                   Optimal_Stack **inserted, uint32_t count) {
+  for (uint32_t i = 0; context->above != NULL && i < removed; ++i) context->above = context->above->next;
+  for (uint32_t i = count; i-- > 0;) context->above = optimal_level(arena, inserted[i], context->above);
+}
+
+static bool optimal_stack_equal(const Optimal_Stack *a, const Optimal_Stack *b) {
+  for (; a != NULL && b != NULL && a != b; a = a->next, b = b->next) {
+    if (a->token != b->token) return false;
+    if (a->token != OPTIMAL_TOKEN_PAIR) continue;
+    if (!optimal_stack_equal(a->left, b->left) || !optimal_stack_equal(a->right, b->right)) return false;
+  }
+  return a == b;
+}
+
+// With both fingers at `level`, the levels below are compared in one walk; once the lists share a cell, the rest of
+// the levels are the same.
+static bool optimal_context_equal_below(Arena *arena, Optimal_Context a, Optimal_Context b, uint32_t level) {
+  optimal_context_seek(arena, &a, level);
+  optimal_context_seek(arena, &b, level);
+  for (const Optimal_Level *x = a.below, *y = b.below; x != y; x = x->next, y = y->next) {
+    if (!optimal_stack_equal(x->stack, y->stack)) return false;
+  }
+  return true;
+}
+
+/*
+ * Moves `context` across `node` from `slot` to the port the walk leaves by, which is returned in `*slot`. Returns
+ * false if the context does not fit the node, which a net translated from a term never produces.
+ */
+static bool optimal_context_cross(Arena *arena, Optimal_Context *context, const Optimal_Node *node, uint32_t *slot) {
+  optimal_context_seek(arena, context, node->level);
+  Optimal_Stack *top = optimal_context_at(context, 0);
+
+  switch (node->kind) {
+  case OPTIMAL_FAN:
+    if (*slot != 0) {
+      Optimal_Stack *pushed = optimal_stack(arena, *slot == 1 ? OPTIMAL_TOKEN_LEFT : OPTIMAL_TOKEN_RIGHT, top);
+      optimal_context_splice(arena, context, 1, &pushed, 1);
+      *slot = 0;
+      return true;
+    }
+    if (top == NULL || (top->token != OPTIMAL_TOKEN_LEFT && top->token != OPTIMAL_TOKEN_RIGHT)) return false;
+    *slot = top->token == OPTIMAL_TOKEN_LEFT ? 1 : 2;
+    optimal_context_splice(arena, context, 1, &top->next, 1);
+    return true;
+
+  case OPTIMAL_CROISSANT:
+    if (*slot != 0) {
+      Optimal_Stack *square = optimal_stack(arena, OPTIMAL_TOKEN_SQUARE, NULL);
+      optimal_context_splice(arena, context, 0, &square, 1);
+      *slot = 0;
+    } else {
+      optimal_context_splice(arena, context, 1, NULL, 0);
+      *slot = 1;
+    }
+    return true;
+
+  case OPTIMAL_BRACKET:
+    if (*slot != 0) {
+      Optimal_Stack *pair = optimal_stack(arena, OPTIMAL_TOKEN_PAIR, NULL);
+      pair->left = top;
+      pair->right = optimal_context_at(context, 1);
+      optimal_context_splice(arena, context, 2, &pair, 1);
+      *slot = 0;
+      return true;
+    }
+    if (top != NULL && top->token != OPTIMAL_TOKEN_PAIR) return false;
+    Optimal_Stack *halves[2] = {top == NULL ? NULL : top->left, top == NULL ? NULL : top->right};
+    optimal_context_splice(arena, context, 1, halves, 2);
+    *slot = 1;
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+/*
+ * The readback works like the Krivine machine's: an explicit task stack, results pushed to the store in postorder.
+ * An application's function is read straight away and its argument is left on the task stack.
+ */
+typedef enum {
+  OPTIMAL_TASK_READ, // reduce and read back what `from` is wired to
+  OPTIMAL_TASK_ABSTRACTION,
+  OPTIMAL_TASK_APPLICATION,
+} Optimal_Task_Kind;
+
+typedef struct {
+  Optimal_Task_Kind kind;
+  Symbol name;
+  Optimal_Port from;
+  Optimal_Context context;
+  Optimal_Binders *binders; // abstractions of the result enclosing this subterm, innermost first
+} Optimal_Task;
+
+bool optimal_normalize(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *result,
+                       Reduce_Budget budget, Reduce_Stats *stats) {
+  Optimal net = {.budget = budget, .stats = stats, .start = now_seconds()};
+  *stats = (Reduce_Stats){.outcome = REDUCE_NORMAL_FORM};
+
+  Arena arena = {0};
+  Vec(Optimal_Task) tasks = {0};
+  Vec(Term_Index) results = {0};
+  bool ok = false;
+
+  uint32_t root_node;
+  if (!optimal_from_term(&net, src, root, &root_node)) goto done;
+
+  nob_da_append(&tasks, ((Optimal_Task){.kind = OPTIMAL_TASK_READ, .from = optimal_port(root_node, 1)}));
+  while (tasks.count > 0) {
+    Optimal_Task task = tasks.items[--tasks.count];
+
+    switch (task.kind) {
+    case OPTIMAL_TASK_READ: {
+      Optimal_Port from = task.from;
+      for (;;) {
+        // A principal port was reached by optimal_whnf's walk already, only a new branch needs reducing.
+        if (optimal_port_slot(from) != 0 && !optimal_whnf(&net, from)) goto done;
+
+        Optimal_Port to = optimal_partner(&net, from);
+        uint32_t node = optimal_port_node(to);
+        uint32_t slot = optimal_port_slot(to);
+        const Optimal_Node *n = &net.nodes.items[node];
+
+        if (n->kind == OPTIMAL_LAMBDA && slot == 0) {
+          Optimal_Binders *binders = arena_alloc(&arena, sizeof(Optimal_Binders));
+          assert(binders != NULL && "Out of memory");
+          *binders = (Optimal_Binders){.lambda = node, .context = task.context, .next = task.binders};
+
+          nob_da_append(&tasks, ((Optimal_Task){.kind = OPTIMAL_TASK_ABSTRACTION, .name = n->name}));
+          nob_da_append(&tasks, ((Optimal_Task){.kind = OPTIMAL_TASK_READ, .from = optimal_port(node, 1),
+                                                .context = task.context, .binders = binders}));
+          break;
+        }
+
+        if (n->kind == OPTIMAL_LAMBDA && slot == 2) {
+          uint32_t index = 0;
+          Optimal_Binders *binder = task.binders;
+          for (; binder != NULL; binder = binder->next, index += 1) {
+            if (binder->lambda != node) continue;
+            if (optimal_context_equal_below(&arena, binder->context, task.context, n->level)) break;
+          }
+          if (binder == NULL) goto invalid;
+          nob_da_append(&results, term_push_atom(dst, index));
+          break;
+        }
+
+        if (n->kind == OPTIMAL_APPLICATION && slot == 1) {
+          nob_da_append(&tasks, ((Optimal_Task){.kind = OPTIMAL_TASK_APPLICATION}));
+          nob_da_append(&tasks, ((Optimal_Task){.kind = OPTIMAL_TASK_READ, .from = optimal_port(node, 2),
+                                                .context = task.context, .binders = task.binders}));
+          from = optimal_port(node, 0);
+          continue;
+        }
+
+        if (!optimal_context_cross(&arena, &task.context, n, &slot)) goto invalid;
+        from = optimal_port(node, slot);
+      }
+    } break;
+
+    case OPTIMAL_TASK_ABSTRACTION: {
+      Term_Index body = results.items[--results.count];
+      nob_da_append(&results, term_push_abstraction(dst, task.name, body));
+    } break;
+
+    case OPTIMAL_TASK_APPLICATION: {
+      Term_Index argument = results.items[--results.count];
+      Term_Index function = results.items[--results.count];
+      nob_da_append(&results, term_push_application(dst, function, argument));
+    } break;
+    }
+  }
+
+  assert(results.count == 1);
+  *result = results.items[0];
+  stats->nodes = *result - term_subterm_start(dst, *result) + 1;
+  ok = true;
+  goto done;
+
+invalid:
+  stats->outcome = REDUCE_ERROR;
+
+done:
+  stats->seconds = now_seconds() - net.start;
+  arena_free(&arena);
+  nob_da_free(net.nodes);
+  nob_da_free(net.free);
+  nob_da_free(net.path);
+  nob_da_free(tasks);
+  nob_da_free(results);
+  return ok;
+}
+
+bool optimal_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats) {
+  Term_Store src = {0};
+  Term_Store dst = {0};
+  *stats = (Reduce_Stats){.outcome = REDUCE_ERROR};
+  bool ok = false;
+
+  Term_Index root, result;
+  if (!term_from_tree(&src, *tree, &root)) goto done;
+  if (!optimal_normalize(&dst, &src, root, &result, budget, stats)) {
+    ok = stats->outcome != REDUCE_ERROR;
+    goto done;
+  }
+
+  Tree_Node *node = tree_new_node(arena);
+  if (node == NULL || !term_to_tree(arena, node, &dst, result)) {
+    stats->outcome = REDUCE_ERROR;
+    goto done;
+  }
+  tree_discard(arena, *tree);
+  *tree = node;
+  ok = true;
+
+done:
+  nob_da_free(src);
+  nob_da_free(dst);
+  return ok;
+}
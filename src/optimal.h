@@ -0,0 +1,31 @@
+#pragma once
+
+#include "parser.h"
+#include "reduce.h"
+#include "term.h"
+#include "util.h"
+
+/*
+ * Optimal reduction on sharing graphs (Lamping's algorithm, in the formulation of Asperti and Guerrini).
+ *
+ * The term is translated into an interaction net of abstraction, application, fan (sharing), croissant and
+ * bracket (level bookkeeping) and eraser nodes, every node tagged with a level: an argument sits one level above
+ * the application it is passed to. Reduction only ever rewrites two nodes connected by their principal ports:
+ * beta for an abstraction against an application, annihilation for two equal nodes, and otherwise the node of the
+ * lower level travels through the other one, duplicating it if it is a fan and shifting its level if it is a
+ * croissant or a bracket. Nothing is ever copied before it is needed, and a shared redex is contracted once for all
+ * of its copies, so no beta step is ever duplicated (Lévy-optimal).
+ *
+ * Reduction is lazy: the net is only reduced along the paths the readback follows. The readback walks from the
+ * root, keeping a context of fan choices per level so it can tell which copy of a shared subgraph it is in.
+ *
+ * Only the beta steps are optimal: the croissants and brackets can pile up, and on some terms (towers of Church
+ * numerals) the bookkeeping interactions vastly outnumber the beta steps.
+ *
+ * Steps count beta interactions, nodes count the nodes in the net. If the budget runs out there is no result,
+ * optimal_normalize returns false and optimal_normalize_tree leaves the tree unchanged.
+ */
+
+bool optimal_normalize(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *result,
+                       Reduce_Budget budget, Reduce_Stats *stats);
+bool optimal_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats);
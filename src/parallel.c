@@ -0,0 +1,338 @@
+#include "parallel.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <nob.h>
+
+#define PARALLEL_GRAIN 4096 // subterms smaller than this (in nodes) are developed whole
+#define PARALLEL_UNITS_PER_THREAD 4 // more pieces than threads, so one big piece does not hold up the rest
+
+size_t parallel_threads = 0;
+
+typedef struct {
+  const Term_Store *src;
+  const Term_Index *units; // roots of the disjoint subterms to develop
+  size_t count;
+  Term_Store *stores; // one per unit
+  Term_Index *roots; // developed unit i, in stores[i]
+  size_t *contracted; // per unit
+  atomic_size_t next; // first unit nobody has taken yet
+} Parallel_Job;
+
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t wake; // a job was posted, or the pool is shutting down
+  pthread_cond_t idle; // the last worker finished the current job
+  Vec(pthread_t) threads;
+  Parallel_Job *job;
+  size_t generation; // bumped for every job, so a worker never runs the same one twice
+  size_t busy; // workers still on the current job
+  bool quit;
+} Parallel_Pool;
+
+static void parallel_run(Parallel_Job *job) {
+  for (;;) {
+    size_t i = atomic_fetch_add(&job->next, 1);
+    if (i >= job->count) break;
+    job->stores[i].count = 0;
+    term_develop(&job->stores[i], job->src, job->units[i], &job->roots[i], &job->contracted[i]);
+  }
+}
+
+static void *parallel_worker(void *arg) {
+  Parallel_Pool *pool = arg;
+  size_t seen = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+  for (;;) {
+    while (!pool->quit && pool->generation == seen) pthread_cond_wait(&pool->wake, &pool->mutex);
+    if (pool->quit) break;
+    seen = pool->generation;
+    Parallel_Job *job = pool->job;
+    pthread_mutex_unlock(&pool->mutex);
+
+    parallel_run(job);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->busy == 0) pthread_cond_signal(&pool->idle);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+static void parallel_pool_init(Parallel_Pool *pool, size_t workers) {
+  *pool = (Parallel_Pool){0};
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+
+  for (size_t i = 0; i < workers; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, parallel_worker, pool) != 0) {
+      nob_log(NOB_WARNING, "Could only start %zu of %zu worker threads", i, workers);
+      break;
+    }
+    nob_da_append(&pool->threads, thread);
+  }
+}
+
+static void parallel_pool_free(Parallel_Pool *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->mutex);
+
+  nob_da_foreach(pthread_t, thread, &pool->threads) pthread_join(*thread, NULL);
+  nob_da_free(pool->threads);
+  pthread_cond_destroy(&pool->idle);
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->mutex);
+}
+
+// Runs the job on the calling thread and every worker, returns once all of its units are developed.
+static void parallel_pool_run(Parallel_Pool *pool, Parallel_Job *job) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->job = job;
+  pool->busy = pool->threads.count;
+  pool->generation += 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->mutex);
+
+  parallel_run(job);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->busy > 0) pthread_cond_wait(&pool->idle, &pool->mutex);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * The pool is started on first use and kept for later calls, so a corpus does not start and join its threads once per
+ * term. It is started again only when parallel_threads asks for a different number, and stopped by parallel_shutdown.
+ */
+static Parallel_Pool parallel_pool;
+static size_t parallel_pool_size; // threads it was started for, including the calling one, 0 if it is not running
+
+void parallel_shutdown(void) {
+  if (parallel_pool_size == 0) return;
+  parallel_pool_free(&parallel_pool);
+  parallel_pool_size = 0;
+}
+
+typedef struct {
+  Parallel_Pool *pool;
+  size_t threads; // including the calling one
+  Vec(Term_Index) units;
+  Vec(Term_Store) stores;
+  Vec(Term_Index) roots;
+  Vec(size_t) contracted;
+} Parallel;
+
+static bool parallel_splittable(const Term_Store *store, Term_Index node) {
+  Term_Node n = store->items[node];
+  switch (term_kind(n)) {
+  case LAMBDA_ATOM: return false;
+  case LAMBDA_ABSTRACTION: return true;
+  case LAMBDA_APPLICATION: return term_kind(store->items[n.left]) != LAMBDA_ABSTRACTION; // a redex stays whole
+  }
+  return false;
+}
+
+static int parallel_compare_index(const void *a, const void *b) {
+  Term_Index x = *(const Term_Index *)a, y = *(const Term_Index *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * Cuts the term into disjoint units, splitting the biggest splittable one until there are enough of them. Above
+ * the units there are only applications and abstractions that are not part of a redex, which a development leaves
+ * as they are, so the units can be developed on their own (their free atoms just refer to the binders above).
+ */
+static void parallel_split(Parallel *parallel, const Term_Store *src, Term_Index root) {
+  parallel->units.count = 0;
+  nob_da_append(&parallel->units, root);
+  if (parallel->threads <= 1) return;
+
+  size_t target = parallel->threads * PARALLEL_UNITS_PER_THREAD;
+  while (parallel->units.count < target) {
+    size_t biggest = SIZE_MAX, biggest_size = 0;
+    for (size_t i = 0; i < parallel->units.count; ++i) {
+      Term_Index unit = parallel->units.items[i];
+      size_t size = unit - term_subterm_start(src, unit) + 1;
+      if (size >= PARALLEL_GRAIN && size > biggest_size && parallel_splittable(src, unit)) {
+        biggest = i;
+        biggest_size = size;
+      }
+    }
+    if (biggest == SIZE_MAX) break;
+
+    Term_Node node = src->items[parallel->units.items[biggest]];
+    parallel->units.items[biggest] = node.right;
+    if (node.left != TERM_NONE) nob_da_append(&parallel->units, node.left);
+  }
+
+  qsort(parallel->units.items, parallel->units.count, sizeof(Term_Index), parallel_compare_index);
+}
+
+// Rebuilds the nodes above the units around their developed versions, in postorder.
+static Term_Index parallel_stitch(Parallel *parallel, Term_Store *dst, const Term_Store *src, Term_Index root) {
+  typedef struct {
+    Term_Index node;
+    bool expanded;
+  } Frame;
+
+  Vec(Frame) stack = {0};
+  Vec(Term_Index) results = {0};
+
+  nob_da_append(&stack, ((Frame){.node = root}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    Term_Index *unit = bsearch(&frame.node, parallel->units.items, parallel->units.count, sizeof(Term_Index),
+                               parallel_compare_index);
+    if (unit != NULL) {
+      size_t i = unit - parallel->units.items;
+      nob_da_append(&results, term_copy(dst, &parallel->stores.items[i], parallel->roots.items[i]));
+      continue;
+    }
+
+    Term_Node node = src->items[frame.node];
+    assert(term_kind(node) != LAMBDA_ATOM && "Every atom is inside a unit");
+    if (!frame.expanded) {
+      nob_da_append(&stack, ((Frame){.node = frame.node, .expanded = true}));
+      nob_da_append(&stack, ((Frame){.node = node.right}));
+      if (node.left != TERM_NONE) nob_da_append(&stack, ((Frame){.node = node.left}));
+    } else if (term_kind(node) == LAMBDA_ABSTRACTION) {
+      Term_Index body = results.items[--results.count];
+      nob_da_append(&results, term_push(dst, LAMBDA_ABSTRACTION, term_data(node), TERM_NONE, body));
+    } else {
+      Term_Index right = results.items[--results.count];
+      Term_Index left = results.items[--results.count];
+      nob_da_append(&results, term_push_application(dst, left, right));
+    }
+  }
+
+  Term_Index result = results.items[0];
+  nob_da_free(stack);
+  nob_da_free(results);
+  return result;
+}
+
+// One Gross-Knuth step: develops `root` from src into dst, a term on its own, spreading the work over the pool.
+static void parallel_develop(Parallel *parallel, Term_Store *dst, const Term_Store *src, Term_Index root,
+                             Term_Index *new_root, size_t *contracted) {
+  parallel_split(parallel, src, root);
+  if (parallel->units.count == 1) {
+    term_develop(dst, src, root, new_root, contracted);
+    return;
+  }
+
+  size_t count = parallel->units.count;
+  while (parallel->stores.count < count) nob_da_append(&parallel->stores, ((Term_Store){0}));
+  nob_da_reserve(&parallel->roots, count);
+  nob_da_reserve(&parallel->contracted, count);
+
+  Parallel_Job job = {
+      .src = src,
+      .units = parallel->units.items,
+      .count = count,
+      .stores = parallel->stores.items,
+      .roots = parallel->roots.items,
+      .contracted = parallel->contracted.items,
+  };
+  atomic_init(&job.next, 0);
+  parallel_pool_run(parallel->pool, &job);
+
+  *contracted = 0;
+  for (size_t i = 0; i < count; ++i) *contracted += parallel->contracted.items[i];
+  *new_root = parallel_stitch(parallel, dst, src, root);
+}
+
+bool parallel_normalize(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *result,
+                        Reduce_Budget budget, Reduce_Stats *stats) {
+  double start = now_seconds();
+  size_t threads = parallel_threads;
+  if (threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? (size_t)online : 1;
+  }
+  if (parallel_pool_size != threads) {
+    parallel_shutdown();
+    parallel_pool_init(&parallel_pool, threads - 1);
+    parallel_pool_size = threads;
+  }
+  Parallel parallel = {.pool = &parallel_pool, .threads = parallel_pool.threads.count + 1};
+
+  // Each development reads one store and writes the other.
+  Term_Store stores[2] = {0};
+  size_t current = 0;
+  Term_Index term = term_copy(&stores[current], src, root);
+
+  // The clock is read after every development: they are few and far more expensive than reading it.
+  Reduce_Budget counts = budget;
+  counts.max_seconds = 0;
+
+  *stats = (Reduce_Stats){.peak_nodes = stores[current].count};
+  for (;;) {
+    if (reduce_budget_exhausted(counts, stats->steps, stores[current].count, start, &stats->outcome)) break;
+    if (budget.max_seconds > 0 && now_seconds() - start > budget.max_seconds) {
+      stats->outcome = REDUCE_TIME_LIMIT;
+      break;
+    }
+
+    Term_Store *next = &stores[1 - current];
+    next->count = 0;
+    Term_Index developed;
+    size_t contracted;
+    parallel_develop(&parallel, next, &stores[current], term, &developed, &contracted);
+    if (contracted == 0) {
+      stats->outcome = REDUCE_NORMAL_FORM;
+      break;
+    }
+
+    stats->steps += contracted;
+    current = 1 - current;
+    term = developed;
+    if (stores[current].count > stats->peak_nodes) stats->peak_nodes = stores[current].count;
+  }
+
+  *result = term_copy(dst, &stores[current], term);
+  stats->nodes = stores[current].count;
+  stats->seconds = now_seconds() - start;
+
+  nob_da_foreach(Term_Store, store, &parallel.stores) nob_da_free(*store);
+  nob_da_free(parallel.stores);
+  nob_da_free(parallel.units);
+  nob_da_free(parallel.roots);
+  nob_da_free(parallel.contracted);
+  nob_da_free(stores[0]);
+  nob_da_free(stores[1]);
+  return true;
+}
+
+bool parallel_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats) {
+  Term_Store src = {0};
+  Term_Store dst = {0};
+  *stats = (Reduce_Stats){.outcome = REDUCE_ERROR};
+  bool ok = false;
+
+  Term_Index root, result;
+  if (!term_from_tree(&src, *tree, &root)) goto done;
+  if (!parallel_normalize(&dst, &src, root, &result, budget, stats)) goto done;
+
+  Tree_Node *node = tree_new_node(arena);
+  if (node == NULL || !term_to_tree(arena, node, &dst, result)) {
+    stats->outcome = REDUCE_ERROR;
+    goto done;
+  }
+  tree_discard(arena, *tree);
+  *tree = node;
+  ok = true;
+
+done:
+  nob_da_free(src);
+  nob_da_free(dst);
+  return ok;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "parser.h"
+#include "reduce.h"
+#include "term.h"
+#include "util.h"
+
+/*
+ * Parallel Gross-Knuth reduction.
+ *
+ * Every step contracts all the redexes of the term at once (term_develop), which is normalizing like normal order.
+ * Redexes that do not overlap can be contracted independently, so the term is cut into disjoint subterms along
+ * the applications and abstractions above its outermost redexes, and a pool of worker threads develops them,
+ * each into a store of its own. The developed subterms are then stitched back together in postorder, which gives
+ * bit for bit the term a sequential development builds, whatever the number of threads or the order they finish in.
+ *
+ * A development copies every argument into all of its occurrences before reducing it, so this does far more work
+ * than the call-by-need engines, and on towers of Church numerals a single development can blow up exponentially.
+ *
+ * Steps count contracted redexes. The budget is checked between developments, so a development can go past
+ * max_steps or max_nodes. If the budget runs out the partially reduced term is still handed back.
+ */
+
+extern size_t parallel_threads; // worker threads, 0 for one per online CPU
+
+// Stops the worker threads parallel_normalize keeps between calls, if it started any.
+void parallel_shutdown(void);
+bool parallel_normalize(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *result,
+                        Reduce_Budget budget, Reduce_Stats *stats);
+bool parallel_normalize_tree(Arena *arena, Tree_Node **tree, Reduce_Budget budget, Reduce_Stats *stats);
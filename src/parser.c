@@ -9,17 +9,34 @@
 
 #include "util.h"
 
-typedef Pair(size_t, size_t) IndexPair;
-typedef Vec(IndexPair) VecIndexPair;
-
 void tree_free(Tree_Node *tree) {
-  if (tree == NULL) return;
-  if (tree->left != NULL) tree_free(tree->left);
-  if (tree->right != NULL) tree_free(tree->right);
-  free(tree);
+  Vec(Tree_Node *) stack = {0};
+
+  if (tree != NULL) nob_da_append(&stack, tree);
+  while (stack.count > 0) {
+    Tree_Node *node = stack.items[--stack.count];
+    if (node->left != NULL) nob_da_append(&stack, node->left);
+    if (node->right != NULL) nob_da_append(&stack, node->right);
+    free(node);
+  }
+
+  nob_da_free(stack);
+}
+
+void tree_discard(Arena *arena, Tree_Node *tree) {
+  // Arena nodes stay allocated until the arena (or the generation they belong to) is released.
+  if (arena == NULL) tree_free(tree);
 }
 
-bool tree_add_left_child(Tree_Node *node) {
+Tree_Node *tree_new_node(Arena *arena) {
+  if (arena == NULL) return calloc(1, sizeof(Tree_Node));
+
+  Tree_Node *node = arena_alloc(arena, sizeof(Tree_Node));
+  if (node != NULL) *node = (Tree_Node){0};
+  return node;
+}
+
+bool tree_add_left_child(Arena *arena, Tree_Node *node) {
   if (node->left != NULL) {
     Nob_String_Builder sb = {0};
     tree_node_label(&sb, node);
@@ -28,11 +45,13 @@ bool tree_add_left_child(Tree_Node *node) {
     return false;
   }
 
-  node->left = calloc(1, sizeof(Tree_Node));
-  return node->left != NULL;
+  node->left = tree_new_node(arena);
+  if (node->left == NULL) return false;
+  node->left->parent = node;
+  return true;
 }
 
-bool tree_add_right_child(Tree_Node *node) {
+bool tree_add_right_child(Arena *arena, Tree_Node *node) {
   if (node->right != NULL) {
     Nob_String_Builder sb = {0};
     tree_node_label(&sb, node);
@@ -41,8 +60,10 @@ bool tree_add_right_child(Tree_Node *node) {
     return false;
   }
 
-  node->right = calloc(1, sizeof(Tree_Node));
-  return node->right != NULL;
+  node->right = tree_new_node(arena);
+  if (node->right == NULL) return false;
+  node->right->parent = node;
+  return true;
 }
 
 Tree_Node *tree_get_leftmost_node(Tree_Node *node) {
@@ -64,25 +85,25 @@ Tree_Node *tree_get_rightmost_node(Tree_Node *node) {
 }
 
 
-bool compute_matching_parens(const char *term, VecIndexPair *pairs);
-bool tree_parse_lambda_term_impl(VecIndexPair paren_pairs, const char *term, size_t l, size_t r,
-                                 Tree_Node *node, Tree_Node **variable_table);
+bool tree_parse_lambda_term_impl(Arena *arena, const Lambda_Text *text, Tree_Node *tree);
 
-bool tree_parse_lambda_term(Tree_Node *tree, const char *term) {
-  VecIndexPair paren_pairs = {0};
-  if (!compute_matching_parens(term, &paren_pairs)) return false;
-  Tree_Node *variable_table[256] = {0};
+bool tree_parse_lambda_term(Arena *arena, Tree_Node *tree, String_View term) {
+  Lambda_Text text;
+  if (!lambda_text_init(&text, term.data, term.count)) return false;
 
-  bool retval = tree_parse_lambda_term_impl(paren_pairs, term, 0, strlen(term) - 1, tree, variable_table);
+  bool retval = tree_parse_lambda_term_impl(arena, &text, tree);
 
-  nob_da_free(paren_pairs);
+  lambda_text_free(&text);
   return retval;
 }
 
+// Nodes are numbered in their user_data for the edges, which is put back afterwards (the diagram keeps its line
+// indices there).
 void tree_print_graphviz(FILE *f, const Tree_Node *root, bool include_binders) {
   fprintf(f, "strict graph {\n");
 
   Vec(Tree_Node*) queue = {0};
+  Vec(void*) user_data = {0};
   nob_da_append(&queue, (Tree_Node*)root);
 
   size_t i = 0;
@@ -90,6 +111,7 @@ void tree_print_graphviz(FILE *f, const Tree_Node *root, bool include_binders) {
   while (i < queue.count && root != NULL) {
     Tree_Node *node = queue.items[i++];
 
+    nob_da_append(&user_data, node->user_data);
     node->user_data = (void*)i;
 
     sb.count = 0;
@@ -128,32 +150,40 @@ void tree_print_graphviz(FILE *f, const Tree_Node *root, bool include_binders) {
 
   fprintf(f, "}\n");
 
+  // The second pass queued the nodes in the same order as the first.
+  for (i = 0; i < user_data.count; ++i) queue.items[i]->user_data = user_data.items[i];
+
+  nob_da_free(user_data);
   nob_da_free(queue);
   nob_sb_free(sb);
 }
 
-bool compute_matching_parens(const char *term, VecIndexPair *pairs) {
+// One pass over the term, so the parser can find the other end of any paren in constant time.
+bool compute_matching_parens(const char *term, size_t len, Paren_Matches *matches) {
   Vec(size_t) stack = {0};
+  matches->count = 0;
+  nob_da_reserve(matches, len);
+  matches->count = len;
 
-  for (size_t i = 0; i < strlen(term); ++i) {
+  for (size_t i = 0; i < len; ++i) {
+    matches->items[i] = PAREN_NONE;
     if (term[i] == '(') {
       nob_da_append(&stack, i);
     } else if (term[i] == ')') {
       if (stack.count == 0) {
-        fprintf(stderr, "Unmatched ')' in %s\n", term);
+        fprintf(stderr, "Unmatched ')' in %.*s\n", (int)len, term);
         fprintf(stderr, "%*s^\n", 17 + (int)i, "");
+        nob_da_free(stack);
         return false;
       }
-      IndexPair p = {
-          .left = stack.items[--stack.count],
-          .right = i,
-      };
-      nob_da_append(pairs, p);
+      size_t left = stack.items[--stack.count];
+      matches->items[left] = i;
+      matches->items[i] = left;
     }
   }
 
   if (stack.count != 0) {
-    fprintf(stderr, "Unmatched '(' in %s\n", term);
+    fprintf(stderr, "Unmatched '(' in %.*s\n", (int)len, term);
     fprintf(stderr, "%*s^\n", 17 + (int)stack.items[stack.count - 1], "");
     nob_da_free(stack);
     return false;
@@ -163,119 +193,458 @@ bool compute_matching_parens(const char *term, VecIndexPair *pairs) {
   return true;
 }
 
-size_t matching_right_paren(VecIndexPair pairs, size_t self) {
-  for (size_t i = 0; i < pairs.count; ++i) {
-    if (pairs.items[i].left == self) {
-      return pairs.items[i].right;
-    }
+// isspace in the C locale, without the per-character library call.
+static bool lambda_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool lambda_text_init(Lambda_Text *text, const char *term, size_t len) {
+  *text = (Lambda_Text){.term = term, .len = len};
+  if (!compute_matching_parens(term, len, &text->parens)) {
+    nob_da_free(text->parens);
+    return false;
   }
 
-  return -1;
+  for (size_t i = 0; i < len && !text->words; ++i) text->words = lambda_space(term[i]);
+  return true;
 }
 
-size_t matching_left_paren(VecIndexPair pairs, size_t self) {
-  for (size_t i = 0; i < pairs.count; ++i) {
-    if (pairs.items[i].right == self) {
-      return pairs.items[i].left;
-    }
-  }
+void lambda_text_free(Lambda_Text *text) {
+  nob_da_free(text->parens);
+}
 
-  return -1;
+static bool lambda_name_char(char c) {
+  return !lambda_space(c) && c != '(' && c != ')' && c != '.';
 }
 
-bool tree_parse_lambda_term_impl(VecIndexPair paren_pairs, const char *term, size_t l, size_t r,
-                                 Tree_Node *node, Tree_Node **variable_table) {
+bool lambda_text_split(const Lambda_Text *text, size_t l, size_t r, Lambda_Split *split) {
+  const char *term = text->term;
   size_t len = r - l + 1;
-  if (term == NULL || len == 0) {
-    node = NULL;
+
+  // Whitespace and parens around the whole subterm do not change it.
+  for (;;) {
+    while (text->words && len > 0 && lambda_space(term[l])) l += 1, len -= 1;
+    while (text->words && len > 0 && lambda_space(term[r])) r -= 1, len -= 1;
+    if (len < 2 || term[l] != '(' || text->parens.items[l] != r) break;
+    l += 1;
+    r -= 1;
+    len -= 2;
+  }
+
+  if (len == 0) {
+    fprintf(stderr, "Could not parse lambda term. Empty subterm in %.*s\n", (int)text->len, term);
+    return false;
+  }
+
+  if (!text->words) {
+    if (len == 1) {
+      *split = (Lambda_Split){.kind = LAMBDA_ATOM, .name = (unsigned char)term[l]};
+      return true;
+    }
+
+    if (term[l] == 'l') {
+      size_t i = 0;
+      while (l + i < r && term[l + i] != '.') {
+        i += 1;
+      }
+
+      if (term[l + i] != '.' || i < 2) {
+        fprintf(stderr, "Could not parse lambda term. Unmatched 'l' in lambda abstraction in %.*s\n",
+                (int)text->len, term);
+        fprintf(stderr, "%*s^\n", 68 + (int)l, "");
+        return false;
+      }
+
+      // Only the character right after the 'l' is bound.
+      *split = (Lambda_Split){.kind = LAMBDA_ABSTRACTION, .name = (unsigned char)term[l + 1], .l = l + i + 1, .r = r};
+      return true;
+    }
+
+    size_t i = (term[r] == ')') ? text->parens.items[r] : r;
+    *split = (Lambda_Split){.kind = LAMBDA_APPLICATION, .l = l, .r = i - 1, .argument_l = i, .argument_r = r};
     return true;
   }
 
-  if (term[l] == '(') {
-    if (matching_right_paren(paren_pairs, l) == r) {
-      l += 1;
-      r -= 1;
-      len -= 2;
+  if (term[l] == 'l') {
+    size_t end = l + 1;
+    while (end <= r && lambda_name_char(term[end])) end += 1;
+    if (end <= r && term[end] == '.') {
+      if (end == l + 1) {
+        fprintf(stderr, "Could not parse lambda term. Missing name after 'l' in %.*s\n", (int)text->len, term);
+        fprintf(stderr, "%*s^\n", 55 + (int)l, "");
+        return false;
+      }
+      Symbol name = symbol_intern(sv_from_parts(term + l + 1, end - l - 1));
+      *split = (Lambda_Split){.kind = LAMBDA_ABSTRACTION, .name = name, .l = end + 1, .r = r};
+      return true;
     }
+    // Otherwise it is a name that happens to start with an 'l'.
   }
 
-  if (len == 1) {
-    node->kind = LAMBDA_ATOM;
-    node->atom = term[l];
-    node->binder = variable_table[(size_t)node->atom];
-    assert(node->binder != NULL &&
-           "This atom's binder should have been recorded in the variable table before we got to it.");
-  } else if (term[l] == 'l') {
-    node->kind = LAMBDA_ABSTRACTION;
-
-    size_t i = 0;
-    while (l + i < r && term[l + i] != '.') {
-      i += 1;
+  // The argument is the last parenthesized subterm or name.
+  size_t i = r;
+  if (term[r] == ')') {
+    i = text->parens.items[r];
+  } else if (lambda_name_char(term[r])) {
+    while (i > l && lambda_name_char(term[i - 1])) i -= 1;
+  } else {
+    fprintf(stderr, "Could not parse lambda term. Unexpected '%c' in %.*s\n", term[r], (int)text->len, term);
+    fprintf(stderr, "%*s^\n", 47 + (int)r, "");
+    return false;
+  }
+
+  if (i == l) {
+    *split = (Lambda_Split){.kind = LAMBDA_ATOM, .name = symbol_intern(sv_from_parts(term + l, len))};
+  } else {
+    *split = (Lambda_Split){.kind = LAMBDA_APPLICATION, .l = l, .r = i - 1, .argument_l = i, .argument_r = r};
+  }
+  return true;
+}
+
+/*
+ * Iterative, so the nesting depth of a term is only bounded by memory: a task either parses term[l..r] into node,
+ * or (node == NULL) takes the binding of an abstraction out of scope once its body has been parsed. Binders are
+ * looked up in a table indexed by symbol, which the unbind tasks restore as scopes close.
+ */
+bool tree_parse_lambda_term_impl(Arena *arena, const Lambda_Text *text, Tree_Node *tree) {
+  typedef struct {
+    size_t l, r;
+    Tree_Node *node;
+    Symbol atom; // the atom to unbind, if node == NULL
+    Tree_Node *shadowed; // the binding to restore, if node == NULL
+  } Task;
+
+  Vec(Task) stack = {0};
+  Vec(Tree_Node *) bindings = {0}; // per symbol, the abstraction binding it in the current scope
+  bool ok = true;
+
+  nob_da_append(&stack, ((Task){.l = 0, .r = text->len - 1, .node = tree}));
+  while (stack.count > 0) {
+    Task task = stack.items[--stack.count];
+    if (task.node == NULL) {
+      // The binding goes out of scope with the abstraction.
+      bindings.items[task.atom] = task.shadowed;
+      continue;
     }
 
-    if (i >= len) {
-      fprintf(stderr, "Could not parse lambda term. Unmatched 'l' in lambda abstraction in %s\n", term);
-      fprintf(stderr, "%*s^", 68 + (int)l, "");
-      return false;
+    Tree_Node *node = task.node;
+    Lambda_Split split;
+    if (!lambda_text_split(text, task.l, task.r, &split)) {
+      ok = false;
+      break;
     }
+    while (bindings.count < symbol_count()) nob_da_append(&bindings, NULL);
+
+    node->kind = split.kind;
+    switch (split.kind) {
+    case LAMBDA_ATOM: {
+      node->atom = split.name;
+      node->binder = bindings.items[split.name];
+      if (node->binder == NULL) {
+        fprintf(stderr, "Could not parse lambda term. Atom '" SV_Fmt "' has no binder in %.*s\n",
+                SV_Arg(symbol_name(split.name)), (int)text->len, text->term);
+        ok = false;
+      }
+    } break;
+    case LAMBDA_ABSTRACTION: {
+      if (!tree_add_left_child(arena, node) || !tree_add_right_child(arena, node)) {
+        ok = false;
+        break;
+      }
+
+      node->left->atom = split.name;
+      nob_da_append(&stack, ((Task){.atom = split.name, .shadowed = bindings.items[split.name]}));
+      bindings.items[split.name] = node;
+      nob_da_append(&stack, ((Task){.l = split.l, .r = split.r, .node = node->right}));
+    } break;
+    case LAMBDA_APPLICATION: {
+      if (!tree_add_left_child(arena, node) || !tree_add_right_child(arena, node)) {
+        ok = false;
+        break;
+      }
+      nob_da_append(&stack, ((Task){.l = split.argument_l, .r = split.argument_r, .node = node->right}));
+      nob_da_append(&stack, ((Task){.l = split.l, .r = split.r, .node = node->left}));
+    } break;
+    }
+    if (!ok) break;
+  }
+
+  nob_da_free(stack);
+  nob_da_free(bindings);
+  return ok;
+}
 
-    if (!tree_add_left_child(node)) return false;
-    if (!tree_add_right_child(node)) return false;
+/*
+ * Labels print the names the parser read, but a reduction can move an atom under an abstraction that binds the same
+ * name as the atom's own binder further out: (ly.(lx.ly.xy)y) reduces to one that would print as (ly.(ly.(yy))).
+ * A first pass over the term finds the abstractions that capture an atom that way, the second gives them a fresh
+ * name, the first of NAME', NAME'', ... that no atom or abstraction of the term uses and no binder in scope prints.
+ *
+ * As in the parser, each symbol has a slot for the binding it currently stands for, which unbinding restores. An
+ * atom whose slot holds some other binding is captured, and its own binding is found by its binder in a table of the
+ * term's abstractions. Fresh names go into a symbol table of the label's own, never into the shared one.
+ */
+typedef struct {
+  Symbol name;
+  Symbol printed; // below Label_Scope.first_fresh a symbol, from there on one of Label_Scope.fresh
+  size_t abstraction; // in preorder, indexing Label_Scope.renamed
+  size_t shadowed; // the binding of the same name this one hides, or LABEL_NONE
+  size_t hides; // the bindings of the same name from this index on hide an atom bound further out, or LABEL_NONE
+  Tree_Node *binder;
+} Label_Binding;
+
+typedef struct {
+  const Tree_Node *binder; // NULL for an empty slot
+  size_t abstraction;
+} Label_Abstraction;
+
+#define LABEL_NONE ((size_t)-1)
+#define LABEL_INITIAL_CAPACITY 64
+
+typedef struct {
+  Vec(Label_Binding) bindings; // innermost last, so the index of a binding is its depth
+  Vec(size_t) current; // per symbol, the binding it stands for, or LABEL_NONE
+  Vec(size_t) printing; // per printed name, how many bindings in scope print as it
+  Vec(bool) present; // per symbol, whether an atom or abstraction of the term uses it
+  Vec(bool) renamed; // per abstraction, whether it captures an atom that is bound further out
+  Vec(size_t) depths; // per abstraction, the index of its binding while it is in scope
+  Label_Abstraction *by_binder; // open addressing
+  size_t capacity; // of by_binder, a power of two, or 0
+  size_t abstractions;
+  Symbol_Table fresh;
+  Symbol first_fresh;
+  Nob_String_Builder spelling; // the fresh name being tried
+  bool words; // some name is longer than a character, so the label needs whitespace to be read back the same way
+} Label_Scope;
+
+// splitmix64 finalizer
+static uint64_t label_mix(uint64_t hash) {
+  hash ^= hash >> 30;
+  hash *= UINT64_C(0xbf58476d1ce4e5b9);
+  hash ^= hash >> 27;
+  hash *= UINT64_C(0x94d049bb133111eb);
+  return hash ^ (hash >> 31);
+}
 
-    node->left->atom = term[l + 1];
+static void label_scope_add(Label_Scope *scope, const Tree_Node *binder, size_t abstraction) {
+  if (2 * (scope->abstractions + 1) > scope->capacity) {
+    Label_Abstraction *old = scope->by_binder;
+    size_t old_capacity = scope->capacity;
+    scope->capacity = old_capacity > 0 ? old_capacity * 2 : LABEL_INITIAL_CAPACITY;
+    scope->by_binder = calloc(scope->capacity, sizeof(Label_Abstraction));
+    assert(scope->by_binder != NULL && "Out of memory");
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old[i].binder != NULL) label_scope_add(scope, old[i].binder, old[i].abstraction);
+    }
+    free(old);
+  }
 
-    // NOTE: This check does not allow to bind the same variable name multiple times in the same bound expression
-    // (but in disjoint abstractions).
+  size_t i = label_mix((uint64_t)(uintptr_t)binder) & (scope->capacity - 1);
+  while (scope->by_binder[i].binder != NULL) i = (i + 1) & (scope->capacity - 1);
+  scope->by_binder[i] = (Label_Abstraction){.binder = binder, .abstraction = abstraction};
+}
 
-    /* if (variable_table[(size_t)*node->left->name.data] != 0) { */
-    /*   fprintf(stderr, "Variable '" SV_Fmt "' already bound.\n", SV_Arg(node->left->name)); */
-    /*   return false; */
-    /* } */
-    variable_table[(size_t)node->left->atom] = node;
+static void label_scope_use(Label_Scope *scope, Symbol name) {
+  scope->present.items[name] = true;
+  if (name >= SYMBOL_FIRST_INTERNED) scope->words = true;
+}
 
-    if (!tree_parse_lambda_term_impl(paren_pairs, term, l + i + 1, r, node->right, variable_table))
-      return false;
-  } else {
-    node->kind = LAMBDA_APPLICATION;
+static void label_scope_bind(Label_Scope *scope, Tree_Node *binder, Symbol name, Symbol printed) {
+  Label_Binding binding = {
+    .name = name,
+    .printed = printed,
+    .abstraction = scope->abstractions++,
+    .shadowed = scope->current.items[name],
+    .hides = LABEL_NONE,
+    .binder = binder,
+  };
+  scope->depths.items[binding.abstraction] = scope->bindings.count;
+  scope->current.items[name] = scope->bindings.count;
+  scope->printing.items[printed] += 1;
+  nob_da_append(&scope->bindings, binding);
+}
 
-    size_t i = (term[r] == ')') ? matching_left_paren(paren_pairs, r) : r;
+static void label_scope_hide(Label_Scope *scope, size_t binding, size_t outer) {
+  Label_Binding *hiding = &scope->bindings.items[binding];
+  scope->renamed.items[hiding->abstraction] = true;
+  hiding->hides = min(hiding->hides, outer);
+}
 
-    if (!tree_add_left_child(node)) return false;
-    if (!tree_add_right_child(node)) return false;
-    if (!tree_parse_lambda_term_impl(paren_pairs, term, l, i - 1, node->left, variable_table)) return false;
-    if (!tree_parse_lambda_term_impl(paren_pairs, term, i, r, node->right, variable_table)) return false;
+static void label_scope_unbind(Label_Scope *scope) {
+  Label_Binding binding = scope->bindings.items[--scope->bindings.count];
+  scope->current.items[binding.name] = binding.shadowed;
+  scope->printing.items[binding.printed] -= 1;
+  // The binding it shadowed hides the same atoms, unless it is the one binding them.
+  if (binding.hides != LABEL_NONE && binding.shadowed != LABEL_NONE && binding.shadowed >= binding.hides) {
+    label_scope_hide(scope, binding.shadowed, binding.hides);
   }
+}
 
-  return true;
+// The binding of the atom, or LABEL_NONE if it is bound outside the labeled node.
+static size_t label_scope_lookup(const Label_Scope *scope, const Tree_Node *atom) {
+  size_t current = scope->current.items[atom->atom];
+  if (current != LABEL_NONE && scope->bindings.items[current].binder == atom->binder) return current;
+  if (scope->capacity == 0) return LABEL_NONE;
+
+  for (size_t i = label_mix((uint64_t)(uintptr_t)atom->binder) & (scope->capacity - 1);
+       scope->by_binder[i].binder != NULL; i = (i + 1) & (scope->capacity - 1)) {
+    if (scope->by_binder[i].binder == atom->binder) return scope->depths.items[scope->by_binder[i].abstraction];
+  }
+  return LABEL_NONE;
+}
+
+// Marks the binding the atom's name stands for, and (as they are unbound) the ones it shadows down to the atom's
+// own, for renaming.
+static void label_scope_capture(Label_Scope *scope, const Tree_Node *atom) {
+  size_t current = scope->current.items[atom->atom];
+  size_t binding = label_scope_lookup(scope, atom);
+  if (current == LABEL_NONE || binding == current) return;
+  label_scope_hide(scope, current, binding != LABEL_NONE ? binding + 1 : 0);
+}
+
+static String_View label_scope_name(const Label_Scope *scope, Symbol printed) {
+  if (printed < scope->first_fresh) return symbol_name(printed);
+  return symbol_table_name(&scope->fresh, printed - scope->first_fresh + SYMBOL_FIRST_INTERNED);
+}
+
+static Symbol label_scope_fresh(Label_Scope *scope, Symbol name) {
+  String_View base = symbol_name(name);
+  scope->spelling.count = 0;
+  nob_sb_append_buf(&scope->spelling, base.data, base.count);
+
+  for (;;) {
+    nob_da_append(&scope->spelling, '\'');
+    String_View spelling = sv_from_parts(scope->spelling.items, scope->spelling.count);
+    // Every name of the term is interned, so a name that is not is not used by it.
+    Symbol symbol = symbol_find(spelling);
+    if (symbol != SYMBOL_NONE && scope->present.items[symbol]) continue;
+
+    Symbol fresh = scope->first_fresh + symbol_table_intern(&scope->fresh, spelling) - SYMBOL_FIRST_INTERNED;
+    while (scope->printing.count <= fresh) nob_da_append(&scope->printing, 0);
+    if (scope->printing.items[fresh] == 0) return fresh;
+  }
 }
 
 void tree_node_label(Nob_String_Builder *sb, Tree_Node *node) {
-  if (node == NULL) {
-    nob_sb_append_cstr(sb, "nil");
-    return;
+  // A task labels a node, appends a piece of punctuation, or takes the innermost binding out of scope once the body
+  // of its abstraction is done.
+  typedef struct {
+    Tree_Node *node;
+    const char *text;
+    bool unbind;
+  } Task;
+
+  Vec(Task) stack = {0};
+  Label_Scope scope = {.first_fresh = symbol_count()};
+  for (Symbol symbol = 0; symbol < scope.first_fresh; ++symbol) {
+    nob_da_append(&scope.current, LABEL_NONE);
+    nob_da_append(&scope.printing, 0);
+    nob_da_append(&scope.present, false);
   }
 
-  switch (node->kind) {
-  case LAMBDA_ATOM:
-    nob_da_append(sb, node->atom);
-    return;
-  case LAMBDA_ABSTRACTION:
-    nob_da_append(sb, '(');
-    nob_da_append(sb, 'l');
-    tree_node_label(sb, node->left);
-    nob_da_append(sb, '.');
-    tree_node_label(sb, node->right);
-    nob_da_append(sb, ')');
-    return;
-  case LAMBDA_APPLICATION:
-    nob_da_append(sb, '(');
-    tree_node_label(sb, node->left);
-    tree_node_label(sb, node->right);
-    nob_da_append(sb, ')');
-    return;
-  default:
-    fprintf(stderr, "[WARN] prostule, you got garbage in your tree node (this used to be a hard error lmao)\n");
-    return;
+  // The first pass only finds the names and the abstractions to rename.
+  nob_da_append(&stack, ((Task){.node = node}));
+  while (stack.count > 0) {
+    Task task = stack.items[--stack.count];
+    Tree_Node *n = task.node;
+    if (task.unbind) label_scope_unbind(&scope);
+    if (n == NULL) continue;
+
+    switch (n->kind) {
+    case LAMBDA_ATOM:
+      label_scope_use(&scope, n->atom);
+      label_scope_capture(&scope, n);
+      break;
+    case LAMBDA_ABSTRACTION:
+      nob_da_append(&scope.renamed, false);
+      nob_da_append(&scope.depths, LABEL_NONE);
+      if (n->left != NULL) {
+        label_scope_use(&scope, n->left->atom);
+        label_scope_add(&scope, n, scope.abstractions);
+        label_scope_bind(&scope, n, n->left->atom, n->left->atom);
+        nob_da_append(&stack, ((Task){.unbind = true}));
+      } else {
+        scope.abstractions += 1;
+      }
+      nob_da_append(&stack, ((Task){.node = n->right}));
+      break;
+    case LAMBDA_APPLICATION:
+      nob_da_append(&stack, ((Task){.node = n->right}));
+      nob_da_append(&stack, ((Task){.node = n->left}));
+      break;
+    default:
+      break;
+    }
+  }
+  for (size_t i = 0; i < scope.renamed.count && !scope.words; ++i) scope.words = scope.renamed.items[i];
+  scope.abstractions = 0;
+
+  nob_da_append(&stack, ((Task){.node = node}));
+  while (stack.count > 0) {
+    Task task = stack.items[--stack.count];
+    if (task.unbind) {
+      label_scope_unbind(&scope);
+      continue;
+    }
+    if (task.text != NULL) {
+      nob_sb_append_cstr(sb, task.text);
+      continue;
+    }
+
+    node = task.node;
+    if (node == NULL) {
+      nob_sb_append_cstr(sb, "nil");
+      continue;
+    }
+
+    // Pushed in reverse, so they come off the stack in order.
+    switch (node->kind) {
+    case LAMBDA_ATOM: {
+      size_t binding = label_scope_lookup(&scope, node);
+      Symbol name = binding != LABEL_NONE ? scope.bindings.items[binding].printed : node->atom;
+      String_View spelling = label_scope_name(&scope, name);
+      nob_sb_append_buf(sb, spelling.data, spelling.count);
+    } break;
+    case LAMBDA_ABSTRACTION: {
+      nob_da_append(sb, '(');
+      nob_da_append(sb, 'l');
+      nob_da_append(&stack, ((Task){.text = ")"}));
+      if (node->left == NULL) {
+        scope.abstractions += 1;
+        nob_sb_append_cstr(sb, "nil.");
+      } else {
+        Symbol name = node->left->atom;
+        Symbol printed = scope.renamed.items[scope.abstractions] ? label_scope_fresh(&scope, name) : name;
+        label_scope_bind(&scope, node, name, printed);
+        String_View spelling = label_scope_name(&scope, printed);
+        nob_sb_append_buf(sb, spelling.data, spelling.count);
+        nob_da_append(sb, '.');
+        if (scope.words) nob_da_append(sb, ' ');
+        nob_da_append(&stack, ((Task){.unbind = true}));
+      }
+      nob_da_append(&stack, ((Task){.node = node->right}));
+    } break;
+    case LAMBDA_APPLICATION:
+      nob_da_append(sb, '(');
+      nob_da_append(&stack, ((Task){.text = ")"}));
+      nob_da_append(&stack, ((Task){.node = node->right}));
+      if (scope.words) nob_da_append(&stack, ((Task){.text = " "}));
+      nob_da_append(&stack, ((Task){.node = node->left}));
+      break;
+    default:
+      fprintf(stderr, "[WARN] Unknown tree node kind %d, left out of the label.\n", (int)node->kind);
+      break;
+    }
   }
-}
 
+  nob_da_free(stack);
+  nob_da_free(scope.bindings);
+  nob_da_free(scope.current);
+  nob_da_free(scope.printing);
+  nob_da_free(scope.present);
+  nob_da_free(scope.renamed);
+  nob_da_free(scope.depths);
+  free(scope.by_binder);
+  symbol_table_free(&scope.fresh);
+  nob_sb_free(scope.spelling);
+}
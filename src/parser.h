@@ -4,6 +4,7 @@
 #include <sv.h>
 #include <nob.h>
 
+#include "symbol.h"
 #include "util.h"
 
 typedef enum {
@@ -15,22 +16,61 @@ typedef enum {
 typedef struct Tree_Node {
   struct Tree_Node *left;
   struct Tree_Node *right;
+  struct Tree_Node *parent; // NULL for the root
 
   Lambda_Expr_Kind kind;
-  char atom; // name of the (bound) atom
+  Symbol atom; // name of the (bound) atom
+  bool dead; // set by the reducer on nodes it cut out of the tree (they stay allocated in its arena)
   struct Tree_Node *binder; // points to this atom's binder if kind == LAMBDA_ATOM, else NULL
 
   void *user_data;
 } Tree_Node;
 
-bool tree_parse_lambda_term(Tree_Node *tree, const char *term);
+// Per character of a term, the index of the paren matching it, or PAREN_NONE if it is not a paren.
+typedef Vec(size_t) Paren_Matches;
+#define PAREN_NONE ((size_t)-1)
+
+// All functions taking an Arena allocate tree nodes from it, or from the heap if it is NULL. Only heap-allocated
+// trees may be passed to tree_free; arena-allocated ones are released together with their arena.
+// Terms are read from `term.data` up to `term.count`, they need not be NUL-terminated (a slice of a mapped file).
+bool tree_parse_lambda_term(Arena *arena, Tree_Node *tree, String_View term);
 void tree_free(Tree_Node *tree);
+void tree_discard(Arena *arena, Tree_Node *tree);
 
-bool tree_add_left_child(Tree_Node *node);
-bool tree_add_right_child(Tree_Node *node);
+Tree_Node *tree_new_node(Arena *arena);
+bool tree_add_left_child(Arena *arena, Tree_Node *node);
+bool tree_add_right_child(Arena *arena, Tree_Node *node);
 
 Tree_Node *tree_get_leftmost_node(Tree_Node *node);
 Tree_Node *tree_get_rightmost_node(Tree_Node *node);
 
 void tree_node_label(Nob_String_Builder *sb, Tree_Node *node);
+
+/*
+ * The text of a term, ready to be cut into subterms, shared by every parser of the syntax (see dag.h).
+ *
+ * Terms are spelled in one of two ways. Without any whitespace, every character other than parens and '.' is an
+ * atom of its own: "lf.lx.f(fx)". With whitespace, atoms are names of any length, separated by whitespace or
+ * parens: "lf.lx.f (f x)", "lsucc.lzero.succ (succ zero)". In both, "lNAME." binds NAME, an abstraction extends as
+ * far right as possible and application associates to the left.
+ */
+typedef struct {
+  const char *term;
+  size_t len;
+  Paren_Matches parens;
+  bool words; // atoms are whitespace-separated names rather than single characters
+} Lambda_Text;
+
+// What term[l..r] is, and where its parts are.
+typedef struct {
+  Lambda_Expr_Kind kind;
+  Symbol name; // LAMBDA_ATOM: the atom, LAMBDA_ABSTRACTION: the name it binds
+  size_t l, r; // LAMBDA_ABSTRACTION: the body, LAMBDA_APPLICATION: the function
+  size_t argument_l, argument_r; // LAMBDA_APPLICATION
+} Lambda_Split;
+
+bool compute_matching_parens(const char *term, size_t len, Paren_Matches *matches);
+bool lambda_text_init(Lambda_Text *text, const char *term, size_t len);
+bool lambda_text_split(const Lambda_Text *text, size_t l, size_t r, Lambda_Split *split);
+void lambda_text_free(Lambda_Text *text);
 void tree_print_graphviz(FILE *stream, const Tree_Node *root, bool include_binders);
@@ -0,0 +1,572 @@
+#include "reduce.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nob.h>
+
+#include "term.h"
+#include "util.h"
+
+typedef struct {
+  Tree_Node *dst;
+  Tree_Node *src;
+  size_t depth;
+} Node_Pair;
+
+// Copies src into dst like tree_copy_subtree_to_node, also counting the nodes written.
+static bool tree_copy_into(Arena *arena, Tree_Node *dst, Tree_Node *src, size_t *copied) {
+  Vec(Node_Pair) stack = {0};
+  nob_da_append(&stack, ((Node_Pair){.dst = dst, .src = src, .depth = 0}));
+
+  // Abstractions copied so far on the path to the current node. Atoms bound by one of them are rebound to its
+  // copy, atoms bound outside of src keep their binder.
+  Vec(Node_Pair) binders = {0};
+  bool ok = true;
+  while (stack.count > 0) {
+    Node_Pair curr = stack.items[--stack.count];
+    binders.count = curr.depth;
+    *copied += 1;
+
+    if (curr.src->kind == LAMBDA_ABSTRACTION) {
+      nob_da_append(&binders, curr);
+    };
+
+    // this is a copy
+    curr.dst->kind      = curr.src->kind;
+    curr.dst->binder    = curr.src->binder;
+    curr.dst->atom      = curr.src->atom;
+    curr.dst->user_data = curr.src->user_data;
+
+    if (curr.src->kind == LAMBDA_ATOM) {
+      for (size_t i = binders.count; i > 0; --i) {
+        if (binders.items[i - 1].src == curr.src->binder) {
+          curr.dst->binder = binders.items[i - 1].dst;
+          break;
+        }
+      }
+    }
+
+    if (curr.src->left != NULL) {
+      if (!tree_add_left_child(arena, curr.dst)) { ok = false; break; }
+      nob_da_append(&stack, ((Node_Pair){.dst = curr.dst->left, .src = curr.src->left, .depth = binders.count}));
+    }
+
+    if (curr.src->right != NULL) {
+      if (!tree_add_right_child(arena, curr.dst)) { ok = false; break; }
+      nob_da_append(&stack, ((Node_Pair){.dst = curr.dst->right, .src = curr.src->right, .depth = binders.count}));
+    }
+  }
+
+  nob_da_free(stack);
+  nob_da_free(binders);
+
+  return ok;
+}
+
+bool tree_copy_subtree_to_node(Arena *arena, Tree_Node *dst, Tree_Node *src) {
+  if (dst == NULL) return false;
+  tree_discard(arena, dst->left);
+  tree_discard(arena, dst->right);
+  dst->left = NULL;
+  dst->right = NULL;
+
+  if (src == NULL) {
+    dst = NULL;
+    return true;
+  }
+
+  size_t copied = 0;
+  return tree_copy_into(arena, dst, src, &copied);
+}
+
+/*
+ * Copies the live tree into `to` (which is reset first) and points *tree at the copy. Reducing in place leaves
+ * discarded arguments and redex nodes behind in the arena; alternating between two arenas and collecting
+ * every so often releases all of that garbage at once.
+ */
+bool tree_collect(Arena *to, Tree_Node **tree) {
+  arena_reset(to);
+  Tree_Node *copy = tree_new_node(to);
+  if (copy == NULL) return false;
+  if (!tree_copy_subtree_to_node(to, copy, *tree)) return false;
+  *tree = copy;
+  return true;
+}
+
+size_t tree_size(const Tree_Node *tree) {
+  Vec(const Tree_Node *) stack = {0};
+  size_t size = 0;
+
+  if (tree != NULL) nob_da_append(&stack, tree);
+  while (stack.count > 0) {
+    const Tree_Node *node = stack.items[--stack.count];
+    size += 1;
+    if (node->left != NULL) nob_da_append(&stack, node->left);
+    if (node->right != NULL) nob_da_append(&stack, node->right);
+  }
+
+  nob_da_free(stack);
+  return size;
+}
+
+static bool tree_is_redex(const Tree_Node *node) {
+  return !node->dead && node->kind == LAMBDA_APPLICATION && node->left->kind == LAMBDA_ABSTRACTION;
+}
+
+void reducer_set_tree(Reducer *reducer, Tree_Node *tree) {
+  reducer->tree = tree;
+  reducer->nodes = tree_size(tree);
+  reducer->redexes_valid = false;
+  reducer->contracted = NULL;
+  reducer->contractum = NULL;
+}
+
+bool reducer_init(Reducer *reducer, const char *term) {
+  *reducer = (Reducer){0};
+  return reducer_load(reducer, sv_from_cstr(term));
+}
+
+// Drops the reducer's tree but keeps its memory, to be reused by the next one.
+void reducer_reset(Reducer *reducer) {
+  arena_reset(&reducer->generations[0]);
+  arena_reset(&reducer->generations[1]);
+  reducer->generation = 0;
+  reducer->tree = NULL;
+  reducer->nodes = 0;
+  reducer->garbage = 0;
+  reducer->redexes.count = 0;
+  reducer->redexes_valid = false;
+  reducer->contracted = NULL;
+  reducer->contractum = NULL;
+}
+
+// Replaces the reducer's tree with a freshly parsed `term`, in the memory the last one used.
+bool reducer_load(Reducer *reducer, String_View term) {
+  reducer_reset(reducer);
+  Arena *arena = &reducer->generations[reducer->generation];
+
+  Tree_Node *tree = tree_new_node(arena);
+  if (tree == NULL) return false;
+  if (!tree_parse_lambda_term(arena, tree, term)) return false;
+
+  reducer_set_tree(reducer, tree);
+  return true;
+}
+
+void reducer_free(Reducer *reducer) {
+  arena_free(&reducer->generations[0]);
+  arena_free(&reducer->generations[1]);
+  nob_da_free(reducer->redexes);
+  *reducer = (Reducer){0};
+}
+
+// Puts `node` where `old` was in the tree.
+static void tree_replace(Reducer *reducer, Tree_Node *old, Tree_Node *node) {
+  Tree_Node *parent = old->parent;
+  node->parent = parent;
+  if (parent == NULL) reducer->tree = node;
+  else if (parent->left == old) parent->left = node;
+  else parent->right = node;
+}
+
+/*
+ * Contracts the redex `node`: the argument replaces the first occurrence of the bound atom and copies of it replace
+ * the others, or it is marked dead along with everything in it if the atom does not occur at all.
+ */
+static bool beta_contract(Reducer *reducer, Tree_Node *node) {
+  Arena *arena = &reducer->generations[reducer->generation];
+  Vec(Tree_Node*) stack = {0};
+  Vec(Tree_Node*) atoms = {0};
+  bool ok = true;
+
+  Tree_Node *abstraction = node->left;
+  Tree_Node *argument = node->right;
+
+  nob_da_append(&stack, abstraction->right);
+  while (stack.count > 0) {
+    Tree_Node *curr = stack.items[--stack.count];
+
+    if (curr->kind == LAMBDA_ATOM && curr->binder == abstraction) {
+      nob_da_append(&atoms, curr);
+    }
+
+    if (curr->left != NULL) nob_da_append(&stack, curr->left);
+    if (curr->right != NULL) nob_da_append(&stack, curr->right);
+  }
+
+  node->dead = true;
+  abstraction->dead = true;
+  abstraction->left->dead = true;
+  node->left = NULL;
+  node->right = NULL;
+  reducer->garbage += 3;
+
+  if (atoms.count == 0) {
+    size_t argument_size = 0;
+    stack.count = 0;
+    nob_da_append(&stack, argument);
+    while (stack.count > 0) {
+      Tree_Node *curr = stack.items[--stack.count];
+      curr->dead = true;
+      argument_size += 1;
+      if (curr->left != NULL) nob_da_append(&stack, curr->left);
+      if (curr->right != NULL) nob_da_append(&stack, curr->right);
+    }
+    reducer->nodes -= argument_size + 3;
+    reducer->garbage += argument_size;
+  } else {
+    // The argument itself replaces the first occurrence, the others get copies (each of which reuses the atom
+    // node it replaces, hence the -1).
+    for (size_t i = 1; i < atoms.count; ++i) {
+      size_t copied = 0;
+      if (!tree_copy_into(arena, atoms.items[i], argument, &copied)) { ok = false; goto done; }
+      reducer->nodes += copied - 1;
+    }
+
+    tree_replace(reducer, atoms.items[0], argument);
+    atoms.items[0]->dead = true;
+    reducer->nodes -= 4;
+    reducer->garbage += 1;
+  }
+
+  Tree_Node *new_node = abstraction->right;
+  tree_replace(reducer, node, new_node);
+  reducer->contracted = node;
+  reducer->contractum = new_node;
+
+  // Once a step has left behind more garbage than there are live nodes, move the live tree to the other
+  // generation and drop this one. The worklist pointed into the old generation, so its walk starts over.
+  if (reducer->garbage > reducer->nodes) {
+    reducer->generation = 1 - reducer->generation;
+    if (!tree_collect(&reducer->generations[reducer->generation], &reducer->tree)) { ok = false; goto done; }
+    reducer->redexes_valid = false;
+    reducer->garbage = 0;
+    reducer->contracted = NULL;
+    reducer->contractum = NULL;
+  }
+
+done:
+  nob_da_free(stack);
+  nob_da_free(atoms);
+  return ok;
+}
+
+/*
+ * Each strategy finds its next redex with its own traversal and returns NULL once the term is normal for that
+ * strategy (i.e. in normal form, head normal form, weak head normal form or a value).
+ */
+
+/*
+ * Leftmost-outermost: the first redex in preorder. The walk that finds it is kept from one step to the next, its
+ * stack in the reducer's worklist, and stops at every redex. A contraction only changes the subtree of the redex,
+ * which the walk has not entered yet, and everything before it in preorder stays free of redexes but for its parent:
+ * the contractum is pushed to carry on from, and if it is an abstraction that landed in function position the parent
+ * is pushed instead, in place of its argument, which is on top of the stack since the walk got to the redex through
+ * the parent's left child. Each node is visited once after it is created, so finding the next redex is amortised
+ * O(1).
+ */
+static Tree_Node *find_redex_normal_order(Reducer *reducer) {
+  Redex_Worklist *stack = &reducer->redexes;
+  if (!reducer->redexes_valid) {
+    stack->count = 0;
+    nob_da_append(stack, reducer->tree);
+    reducer->redexes_valid = true;
+  }
+
+  while (stack->count > 0) {
+    Tree_Node *node = stack->items[--stack->count];
+    if (tree_is_redex(node)) return node;
+    if (node->kind == LAMBDA_ABSTRACTION) nob_da_append(stack, node->right);
+    if (node->kind == LAMBDA_APPLICATION) {
+      nob_da_append(stack, node->right);
+      nob_da_append(stack, node->left);
+    }
+  }
+
+  return NULL;
+}
+
+// Where the walk of find_redex_normal_order carries on after the redex it found was contracted.
+static void reducer_resume_worklist(Reducer *reducer) {
+  Redex_Worklist *stack = &reducer->redexes;
+  Tree_Node *contractum = reducer->contractum;
+  Tree_Node *parent = contractum->parent;
+
+  if (parent != NULL && parent->left == contractum && tree_is_redex(parent)) {
+    assert(stack->count > 0 && stack->items[stack->count - 1] == parent->right);
+    stack->items[stack->count - 1] = parent;
+  } else {
+    nob_da_append(stack, contractum);
+  }
+}
+
+// Leftmost-innermost: the first redex in postorder, so both the function and the argument are normal by the
+// time a redex is contracted. With descend_abstractions == false this never reduces under a lambda.
+static Tree_Node *find_redex_postorder(Reducer *reducer, bool descend_abstractions) {
+  typedef struct {
+    Tree_Node *node;
+    bool expanded;
+  } Frame;
+
+  Vec(Frame) stack = {0};
+  Tree_Node *redex = NULL;
+
+  nob_da_append(&stack, ((Frame){.node = reducer->tree}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    Tree_Node *node = frame.node;
+
+    if (node->kind == LAMBDA_ABSTRACTION) {
+      if (descend_abstractions) nob_da_append(&stack, ((Frame){.node = node->right}));
+    } else if (node->kind == LAMBDA_APPLICATION) {
+      if (frame.expanded) {
+        if (tree_is_redex(node)) {
+          redex = node;
+          break;
+        }
+      } else {
+        nob_da_append(&stack, ((Frame){.node = node, .expanded = true}));
+        nob_da_append(&stack, ((Frame){.node = node->right}));
+        nob_da_append(&stack, ((Frame){.node = node->left}));
+      }
+    }
+  }
+
+  nob_da_free(stack);
+  return redex;
+}
+
+static Tree_Node *find_redex_applicative_order(Reducer *reducer) {
+  return find_redex_postorder(reducer, true);
+}
+
+// Call-by-value reduces the function, then the argument, then the application itself, but never under a lambda.
+static Tree_Node *find_redex_call_by_value(Reducer *reducer) {
+  return find_redex_postorder(reducer, false);
+}
+
+// The head redex: below the leading abstractions, at the bottom of the application spine.
+static Tree_Node *find_redex_head(Reducer *reducer) {
+  Tree_Node *node = reducer->tree;
+  while (node->kind == LAMBDA_ABSTRACTION) node = node->right;
+  while (node->kind == LAMBDA_APPLICATION) {
+    if (tree_is_redex(node)) return node;
+    node = node->left;
+  }
+  return NULL;
+}
+
+// Like head reduction, but an abstraction at the top is already a weak head normal form.
+static Tree_Node *find_redex_weak_head(Reducer *reducer) {
+  Tree_Node *node = reducer->tree;
+  while (node->kind == LAMBDA_APPLICATION) {
+    if (tree_is_redex(node)) return node;
+    node = node->left;
+  }
+  return NULL;
+}
+
+typedef Tree_Node *(*Redex_Finder)(Reducer *reducer);
+
+static const struct {
+  const char *name;
+  Redex_Finder find;
+} strategies[STRATEGY_COUNT] = {
+    [STRATEGY_NORMAL_ORDER] = {"normal", find_redex_normal_order},
+    [STRATEGY_APPLICATIVE_ORDER] = {"applicative", find_redex_applicative_order},
+    [STRATEGY_HEAD] = {"head", find_redex_head},
+    [STRATEGY_WEAK_HEAD] = {"weak-head", find_redex_weak_head},
+    [STRATEGY_CALL_BY_VALUE] = {"cbv", find_redex_call_by_value},
+};
+
+const char *reduce_strategy_name(Reduce_Strategy strategy) {
+  return strategies[strategy].name;
+}
+
+bool reduce_strategy_from_name(const char *name, Reduce_Strategy *strategy) {
+  // What normal order used to be called when it was the only one with a worklist.
+  if (strcmp(name, "worklist") == 0) {
+    *strategy = STRATEGY_NORMAL_ORDER;
+    return true;
+  }
+
+  for (size_t i = 0; i < STRATEGY_COUNT; ++i) {
+    if (strcmp(strategies[i].name, name) == 0) {
+      *strategy = (Reduce_Strategy)i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool beta_reduce(Reducer *reducer, bool *reducible) {
+  Tree_Node *node = strategies[reducer->strategy].find(reducer);
+  *reducible = node != NULL;
+  reducer->contracted = NULL;
+  reducer->contractum = NULL;
+  if (!*reducible) return true;
+
+  // Only normal order keeps the worklist up to date; the others just invalidate it. A collection moves every node,
+  // which invalidates it too.
+  if (reducer->strategy != STRATEGY_NORMAL_ORDER) reducer->redexes_valid = false;
+  if (!beta_contract(reducer, node)) return false;
+  if (reducer->redexes_valid && reducer->contractum != NULL) reducer_resume_worklist(reducer);
+  return true;
+}
+
+const char *reduce_outcome_name(Reduce_Outcome outcome) {
+  switch (outcome) {
+  case REDUCE_NORMAL_FORM: return "normal form";
+  case REDUCE_STEP_LIMIT: return "step limit";
+  case REDUCE_NODE_LIMIT: return "node limit";
+  case REDUCE_TIME_LIMIT: return "time limit";
+  case REDUCE_CYCLE: return "cycle";
+  case REDUCE_DIVERGENT_GROWTH: return "divergent growth";
+  case REDUCE_ERROR: return "error";
+  }
+  return "unknown";
+}
+
+bool reduce_budget_exhausted(Reduce_Budget budget, size_t steps, size_t nodes, double start,
+                             Reduce_Outcome *outcome) {
+  if (budget.max_steps != 0 && steps >= budget.max_steps) {
+    *outcome = REDUCE_STEP_LIMIT;
+    return true;
+  }
+
+  if (budget.max_nodes != 0 && nodes > budget.max_nodes) {
+    *outcome = REDUCE_NODE_LIMIT;
+    return true;
+  }
+
+  // Reading the clock is only worth it every so often, small steps would spend most of their time in it.
+  if (budget.max_seconds > 0 && steps % REDUCE_CLOCK_INTERVAL == 0 && now_seconds() - start > budget.max_seconds) {
+    *outcome = REDUCE_TIME_LIMIT;
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * Loop detection for reducer_normalize.
+ *
+ * Every so often the term is fingerprinted (term_hash of its de Bruijn form, so a cycle is caught even when the
+ * names of the bound atoms change), and the fingerprints of the last LOOP_FINGERPRINTS samples are kept around. A
+ * term is sampled every 1 + nodes / LOOP_SAMPLE_NODES steps, so hashing costs about LOOP_SAMPLE_NODES node visits
+ * per step whatever the size of the term.
+ * When a fingerprint comes back, the term is copied aside and checked after every step until it comes back again:
+ * seeing the very same term twice proves the cycle (and gives its exact period), so hash collisions and strategies
+ * that take a different turn the second time around cannot stop a reduction that would have finished.
+ *
+ * Growth is tracked at checkpoints whose spacing doubles, starting at LOOP_GROWTH_START steps: a term that got
+ * bigger at each of the last LOOP_GROWTH_CHECKPOINTS of them is called divergent. Unlike a cycle this is a guess.
+ */
+#define LOOP_FINGERPRINTS 64
+#define LOOP_SAMPLE_NODES 256
+#define LOOP_GROWTH_START 256
+#define LOOP_GROWTH_CHECKPOINTS 8
+
+typedef struct {
+  uint64_t fingerprints[LOOP_FINGERPRINTS]; // ring buffer
+  size_t steps[LOOP_FINGERPRINTS]; // when each fingerprint was taken
+  size_t count; // fingerprints taken so far
+
+  Term_Store term; // scratch
+  Term_Store suspect; // a term whose fingerprint came back, being checked for a cycle
+  Term_Index suspect_root;
+  uint64_t suspect_fingerprint;
+  size_t suspect_step;
+  size_t suspect_deadline; // the step by which the suspect has to show up again
+  bool suspecting;
+
+  size_t checkpoint; // step of the next growth checkpoint
+  size_t checkpoint_nodes; // size of the term at the last one
+  size_t growing; // consecutive checkpoints at which the term had grown
+} Loop_Detector;
+
+static bool loop_detected(Loop_Detector *detector, const Tree_Node *tree, size_t nodes, size_t step,
+                          Reduce_Stats *stats) {
+  if (step == detector->checkpoint) {
+    detector->growing = (step > 0 && nodes > detector->checkpoint_nodes) ? detector->growing + 1 : 0;
+    detector->checkpoint_nodes = nodes;
+    detector->checkpoint = (step == 0) ? LOOP_GROWTH_START : 2 * step;
+    if (detector->growing >= LOOP_GROWTH_CHECKPOINTS) {
+      stats->outcome = REDUCE_DIVERGENT_GROWTH;
+      return true;
+    }
+  }
+
+  if (!detector->suspecting && step % (1 + nodes / LOOP_SAMPLE_NODES) != 0) return false;
+
+  Term_Index root;
+  detector->term.count = 0;
+  if (!term_from_tree(&detector->term, tree, &root)) return false;
+  uint64_t fingerprint = term_hash(&detector->term, root);
+
+  if (detector->suspecting) {
+    if (fingerprint == detector->suspect_fingerprint &&
+        term_equal(&detector->suspect, detector->suspect_root, &detector->term, root)) {
+      stats->outcome = REDUCE_CYCLE;
+      stats->cycle_period = step - detector->suspect_step;
+      return true;
+    }
+    if (step < detector->suspect_deadline) return false;
+    detector->suspecting = false; // a false alarm, back to sampling
+  }
+
+  size_t recent = min(detector->count, (size_t)LOOP_FINGERPRINTS);
+  for (size_t i = 0; i < recent && !detector->suspecting; ++i) {
+    if (detector->fingerprints[i] != fingerprint) continue;
+    // The same term again after `lag` steps, so if it is a cycle the period is at most lag.
+    size_t lag = step - detector->steps[i];
+    detector->suspect.count = 0;
+    detector->suspect_root = term_copy(&detector->suspect, &detector->term, root);
+    detector->suspect_fingerprint = fingerprint;
+    detector->suspect_step = step;
+    detector->suspect_deadline = step + lag;
+    detector->suspecting = true;
+  }
+
+  detector->fingerprints[detector->count % LOOP_FINGERPRINTS] = fingerprint;
+  detector->steps[detector->count % LOOP_FINGERPRINTS] = step;
+  detector->count += 1;
+  return false;
+}
+
+// Reduces until the term is in normal form or the budget runs out, without printing or building diagrams.
+bool reducer_normalize(Reducer *reducer, Reduce_Budget budget, Reduce_Stats *stats) {
+  double start = now_seconds();
+  Loop_Detector detector = {0};
+  *stats = (Reduce_Stats){.peak_nodes = reducer->nodes};
+
+  for (;;) {
+    if (reduce_budget_exhausted(budget, stats->steps, reducer->nodes, start, &stats->outcome)) break;
+    if (budget.detect_loops && loop_detected(&detector, reducer->tree, reducer->nodes, stats->steps, stats)) break;
+
+    bool reducible;
+    if (!beta_reduce(reducer, &reducible)) {
+      stats->outcome = REDUCE_ERROR;
+      break;
+    }
+
+    if (!reducible) {
+      stats->outcome = REDUCE_NORMAL_FORM;
+      break;
+    }
+
+    stats->steps += 1;
+    stats->peak_nodes = max(stats->peak_nodes, reducer->nodes);
+  }
+
+  stats->nodes = reducer->nodes;
+  stats->seconds = now_seconds() - start;
+  nob_da_free(detector.term);
+  nob_da_free(detector.suspect);
+  return stats->outcome != REDUCE_ERROR;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "parser.h"
+#include "util.h"
+
+/*
+ * The tree reducer rewrites a Tree_Node in place, one redex per beta_reduce call. The redex is picked by the
+ * reducer's strategy, each with its own traversal. Normal order, the default, keeps the stack of its preorder walk
+ * from one step to the next and carries on from the last contractum instead of starting over from the root. Nodes
+ * are allocated from the current of two arena generations; once enough garbage has piled up, the live tree is copied
+ * into the other generation and the old one is released in one go.
+ */
+typedef Vec(Tree_Node *) Redex_Worklist;
+
+typedef enum {
+  STRATEGY_NORMAL_ORDER, // leftmost-outermost, finds the normal form whenever there is one
+  STRATEGY_APPLICATIVE_ORDER, // leftmost-innermost
+  STRATEGY_HEAD, // only the head redex, stops at a head normal form
+  STRATEGY_WEAK_HEAD, // only the head redex and never under a lambda, stops at a weak head normal form
+  STRATEGY_CALL_BY_VALUE, // leftmost-innermost but never under a lambda, stops at a value
+  STRATEGY_COUNT,
+} Reduce_Strategy;
+
+typedef struct {
+  Arena generations[2];
+  size_t generation; // index of the generation the live tree is allocated from
+  Tree_Node *tree;
+  size_t nodes; // nodes in tree
+  size_t garbage; // nodes discarded since the last collection
+  Reduce_Strategy strategy;
+  Redex_Worklist redexes; // the subtrees normal order's preorder walk has yet to visit, next on top
+  bool redexes_valid; // false until the walk has started, or after a collection or another strategy
+  // What the last beta_reduce changed, for anything that mirrors the tree (see diagram_relayout): the redex it
+  // contracted, which is dead but keeps its parent and user_data, and the node that took its place. Both are NULL
+  // if the step collected the tree, since every node moved.
+  Tree_Node *contracted;
+  Tree_Node *contractum;
+} Reducer;
+
+// A zero field means no limit.
+typedef struct {
+  size_t max_steps;
+  size_t max_nodes;
+  double max_seconds;
+  bool detect_loops; // stop early on a term that comes back (a cycle) or keeps on growing, tree reducer only
+} Reduce_Budget;
+
+typedef enum {
+  REDUCE_NORMAL_FORM, // no redex left for the chosen strategy
+  REDUCE_STEP_LIMIT,
+  REDUCE_NODE_LIMIT,
+  REDUCE_TIME_LIMIT,
+  REDUCE_CYCLE, // the term came back to one it had already been, it never gets anywhere else
+  REDUCE_DIVERGENT_GROWTH, // the term kept on growing (a heuristic, it might still have a normal form)
+  REDUCE_ERROR,
+} Reduce_Outcome;
+
+typedef struct {
+  Reduce_Outcome outcome;
+  size_t steps;
+  size_t nodes; // size of the term when reduction stopped
+  size_t peak_nodes;
+  double seconds;
+  size_t cycle_period; // REDUCE_CYCLE: the term after `steps` steps is the one from cycle_period steps before
+} Reduce_Stats;
+
+bool tree_copy_subtree_to_node(Arena *arena, Tree_Node *dst, Tree_Node *src);
+bool tree_collect(Arena *to, Tree_Node **tree);
+size_t tree_size(const Tree_Node *tree);
+
+bool reducer_init(Reducer *reducer, const char *term);
+bool reducer_load(Reducer *reducer, String_View term);
+void reducer_reset(Reducer *reducer);
+void reducer_set_tree(Reducer *reducer, Tree_Node *tree);
+void reducer_free(Reducer *reducer);
+
+const char *reduce_strategy_name(Reduce_Strategy strategy);
+bool reduce_strategy_from_name(const char *name, Reduce_Strategy *strategy);
+
+bool beta_reduce(Reducer *reducer, bool *reducible);
+bool reducer_normalize(Reducer *reducer, Reduce_Budget budget, Reduce_Stats *stats);
+const char *reduce_outcome_name(Reduce_Outcome outcome);
+
+// Shared by every engine: checks `steps` and `nodes` used since `start` (now_seconds) against the budget.
+#define REDUCE_CLOCK_INTERVAL 256
+bool reduce_budget_exhausted(Reduce_Budget budget, size_t steps, size_t nodes, double start,
+                             Reduce_Outcome *outcome);
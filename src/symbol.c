@@ -0,0 +1,104 @@
+#include "symbol.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nob.h>
+
+#include "term.h"
+
+#define SYMBOL_INITIAL_CAPACITY 256
+
+Symbol_Table symbols = {0};
+
+// Backs the views symbol_name hands out for single-character names, each filled in when first asked for.
+static char symbol_chars[SYMBOL_FIRST_INTERNED];
+
+// FNV-1a
+static uint64_t symbol_hash(String_View name) {
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+  for (size_t i = 0; i < name.count; ++i) hash = (hash ^ (unsigned char)name.data[i]) * UINT64_C(0x100000001b3);
+  return hash;
+}
+
+static void symbol_grow(Symbol_Table *table) {
+  size_t capacity = table->capacity > 0 ? table->capacity * 2 : SYMBOL_INITIAL_CAPACITY;
+  Symbol *slots = malloc(capacity * sizeof(Symbol));
+  assert(slots != NULL && "Out of memory");
+  memset(slots, 0xff, capacity * sizeof(Symbol)); // SYMBOL_NONE
+
+  for (size_t i = 0; i < table->names.count; ++i) {
+    size_t slot = symbol_hash(symbol_table_name(table, (Symbol)(SYMBOL_FIRST_INTERNED + i))) & (capacity - 1);
+    while (slots[slot] != SYMBOL_NONE) slot = (slot + 1) & (capacity - 1);
+    slots[slot] = (Symbol)(SYMBOL_FIRST_INTERNED + i);
+  }
+
+  free(table->table);
+  table->table = slots;
+  table->capacity = capacity;
+}
+
+Symbol symbol_table_intern(Symbol_Table *table, String_View name) {
+  assert(name.count > 0 && "Names are not empty");
+  if (name.count == 1) return (unsigned char)name.data[0];
+
+  if (2 * (table->names.count + 1) > table->capacity) symbol_grow(table);
+  size_t slot = symbol_hash(name) & (table->capacity - 1);
+  for (; table->table[slot] != SYMBOL_NONE; slot = (slot + 1) & (table->capacity - 1)) {
+    if (sv_eq(symbol_table_name(table, table->table[slot]), name)) return table->table[slot];
+  }
+
+  // Symbols name abstractions in a Term_Store, so they have to fit in a node's data bits.
+  Symbol symbol = (Symbol)(SYMBOL_FIRST_INTERNED + table->names.count);
+  assert(symbol < (1u << (32 - TERM_KIND_BITS)) && "Too many distinct names");
+  nob_da_append(&table->names, ((Symbol_Name){.start = table->chars.count, .count = name.count}));
+  nob_sb_append_buf(&table->chars, name.data, name.count);
+  table->table[slot] = symbol;
+  return symbol;
+}
+
+Symbol symbol_table_find(const Symbol_Table *table, String_View name) {
+  assert(name.count > 0 && "Names are not empty");
+  if (name.count == 1) return (unsigned char)name.data[0];
+  if (table->capacity == 0) return SYMBOL_NONE;
+
+  size_t slot = symbol_hash(name) & (table->capacity - 1);
+  for (; table->table[slot] != SYMBOL_NONE; slot = (slot + 1) & (table->capacity - 1)) {
+    if (sv_eq(symbol_table_name(table, table->table[slot]), name)) return table->table[slot];
+  }
+  return SYMBOL_NONE;
+}
+
+String_View symbol_table_name(const Symbol_Table *table, Symbol symbol) {
+  if (symbol < SYMBOL_FIRST_INTERNED) {
+    symbol_chars[symbol] = (char)symbol;
+    return sv_from_parts(&symbol_chars[symbol], 1);
+  }
+  assert(symbol - SYMBOL_FIRST_INTERNED < table->names.count && "Unknown symbol");
+  Symbol_Name name = table->names.items[symbol - SYMBOL_FIRST_INTERNED];
+  return sv_from_parts(table->chars.items + name.start, name.count);
+}
+
+void symbol_table_free(Symbol_Table *table) {
+  nob_sb_free(table->chars);
+  nob_da_free(table->names);
+  free(table->table);
+  *table = (Symbol_Table){0};
+}
+
+Symbol symbol_intern(String_View name) {
+  return symbol_table_intern(&symbols, name);
+}
+
+Symbol symbol_find(String_View name) {
+  return symbol_table_find(&symbols, name);
+}
+
+String_View symbol_name(Symbol symbol) {
+  return symbol_table_name(&symbols, symbol);
+}
+
+void symbol_reset(void) {
+  symbol_table_free(&symbols);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <nob.h>
+#include <sv.h>
+
+#include "util.h"
+
+/*
+ * Interned atom names.
+ *
+ * A Symbol stands for a name, equal names get equal symbols. A single-character name is its own character code, so
+ * terms written with one letter per atom never touch the table and stay bitwise the same in a Term_Store as they
+ * were before names could be longer. Longer names get the symbols from SYMBOL_FIRST_INTERNED on, in the order they
+ * are first seen, so symbols can index flat per-name arrays (e.g. the parsers' binder tables).
+ *
+ * The table keeps its own copy of every name, back to back in one buffer, so terms can be parsed from buffers that
+ * are reused right after (the lines of a corpus). A view from symbol_name is only good until the next symbol_intern,
+ * which may move the buffer. symbol_reset forgets every interned name.
+ *
+ * The symbol_table_ functions do the same on a table of their own, for names that should not end up in the shared
+ * one (e.g. the fresh names the printer makes up). symbol_find only looks a name up and never adds it.
+ */
+
+typedef uint32_t Symbol;
+#define SYMBOL_NONE ((Symbol)UINT32_MAX)
+#define SYMBOL_FIRST_INTERNED 256
+
+typedef struct {
+  size_t start, count; // in Symbol_Table.chars
+} Symbol_Name;
+
+typedef struct {
+  Nob_String_Builder chars;
+  Vec(Symbol_Name) names; // names.items[i] is symbol SYMBOL_FIRST_INTERNED + i
+  Symbol *table; // open addressing, SYMBOL_NONE for an empty slot
+  size_t capacity; // a power of two, or 0
+} Symbol_Table;
+
+extern Symbol_Table symbols;
+
+// One more than the largest symbol handed out so far.
+#define symbol_count() (SYMBOL_FIRST_INTERNED + symbols.names.count)
+
+Symbol symbol_table_intern(Symbol_Table *table, String_View name);
+Symbol symbol_table_find(const Symbol_Table *table, String_View name); // SYMBOL_NONE if it is not in the table
+String_View symbol_table_name(const Symbol_Table *table, Symbol symbol);
+void symbol_table_free(Symbol_Table *table);
+
+Symbol symbol_intern(String_View name);
+Symbol symbol_find(String_View name);
+String_View symbol_name(Symbol symbol);
+void symbol_reset(void);
@@ -0,0 +1,447 @@
+#include "term.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <nob.h>
+
+#include "util.h"
+
+Term_Index term_push(Term_Store *store, Lambda_Expr_Kind kind, uint32_t data, Term_Index left, Term_Index right) {
+  assert(data < (1u << (32 - TERM_KIND_BITS)) && "Term data does not fit in the node head");
+  Term_Node node = {
+      .head = (data << TERM_KIND_BITS) | (uint32_t)kind,
+      .left = left,
+      .right = right,
+  };
+  nob_da_append(store, node);
+  return (Term_Index)(store->count - 1);
+}
+
+Term_Index term_push_atom(Term_Store *store, uint32_t index) {
+  return term_push(store, LAMBDA_ATOM, index, TERM_NONE, TERM_NONE);
+}
+
+Term_Index term_push_abstraction(Term_Store *store, Symbol name, Term_Index body) {
+  return term_push(store, LAMBDA_ABSTRACTION, name, TERM_NONE, body);
+}
+
+Term_Index term_push_application(Term_Store *store, Term_Index function, Term_Index argument) {
+  return term_push(store, LAMBDA_APPLICATION, 0, function, argument);
+}
+
+Term_Index term_subterm_start(const Term_Store *store, Term_Index root) {
+  // In postorder the first node of a subterm is its leftmost descendant.
+  Term_Index i = root;
+  for (;;) {
+    Term_Node node = store->items[i];
+    switch (term_kind(node)) {
+    case LAMBDA_ATOM: return i;
+    case LAMBDA_ABSTRACTION: i = node.right; break;
+    case LAMBDA_APPLICATION: i = node.left; break;
+    }
+  }
+}
+
+Term_Index term_copy(Term_Store *dst, const Term_Store *src, Term_Index root) {
+  Term_Index start = term_subterm_start(src, root);
+  size_t count = root - start + 1;
+  Term_Index base = (Term_Index)dst->count;
+
+  nob_da_reserve(dst, dst->count + count);
+  for (size_t i = 0; i < count; ++i) {
+    Term_Node node = src->items[start + i];
+    if (node.left != TERM_NONE) node.left = node.left - start + base;
+    if (node.right != TERM_NONE) node.right = node.right - start + base;
+    dst->items[dst->count++] = node;
+  }
+
+  return (Term_Index)(dst->count - 1);
+}
+
+bool term_from_tree(Term_Store *store, const Tree_Node *tree, Term_Index *root) {
+  if (tree == NULL) return false;
+
+  typedef struct {
+    const Tree_Node *node;
+    bool expanded;
+  } Frame;
+
+  Vec(Frame) stack = {0};
+  Vec(Term_Index) results = {0};
+  Vec(const Tree_Node *) binders = {0};
+  bool ok = true;
+
+  nob_da_append(&stack, ((Frame){.node = tree}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    const Tree_Node *node = frame.node;
+
+    switch (node->kind) {
+    case LAMBDA_ATOM: {
+      size_t i = binders.count;
+      while (i > 0 && binders.items[i - 1] != node->binder) i -= 1;
+      if (i == 0) {
+        fprintf(stderr, "Cannot convert open term: atom '" SV_Fmt "' has no binder.\n",
+                SV_Arg(symbol_name(node->atom)));
+        ok = false;
+        goto done;
+      }
+      nob_da_append(&results, term_push_atom(store, (uint32_t)(binders.count - i)));
+    } break;
+    case LAMBDA_ABSTRACTION: {
+      if (!frame.expanded) {
+        nob_da_append(&stack, ((Frame){.node = node, .expanded = true}));
+        nob_da_append(&stack, ((Frame){.node = node->right}));
+        nob_da_append(&binders, node);
+      } else {
+        Term_Index body = results.items[--results.count];
+        binders.count -= 1;
+        nob_da_append(&results, term_push_abstraction(store, node->left->atom, body));
+      }
+    } break;
+    case LAMBDA_APPLICATION: {
+      if (!frame.expanded) {
+        nob_da_append(&stack, ((Frame){.node = node, .expanded = true}));
+        nob_da_append(&stack, ((Frame){.node = node->right}));
+        nob_da_append(&stack, ((Frame){.node = node->left}));
+      } else {
+        Term_Index argument = results.items[--results.count];
+        Term_Index function = results.items[--results.count];
+        nob_da_append(&results, term_push_application(store, function, argument));
+      }
+    } break;
+    }
+  }
+
+  assert(results.count == 1);
+  *root = results.items[0];
+
+done:
+  nob_da_free(stack);
+  nob_da_free(results);
+  nob_da_free(binders);
+  return ok;
+}
+
+bool term_to_tree(Arena *arena, Tree_Node *tree, const Term_Store *store, Term_Index root) {
+  if (tree == NULL) return false;
+
+  typedef struct {
+    Tree_Node *dst;
+    Term_Index src;
+    uint32_t depth;
+  } Frame;
+
+  Vec(Frame) stack = {0};
+  Vec(Tree_Node *) binders = {0}; // binders.items[d] is the abstraction at depth d on the current path
+  bool ok = true;
+
+  nob_da_append(&stack, ((Frame){.dst = tree, .src = root, .depth = 0}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    Term_Node node = store->items[frame.src];
+    binders.count = frame.depth;
+
+    frame.dst->kind = term_kind(node);
+    switch (term_kind(node)) {
+    case LAMBDA_ATOM: {
+      uint32_t index = term_data(node);
+      if (index >= frame.depth) {
+        fprintf(stderr, "Cannot convert open term: de Bruijn index %u escapes its %u binders.\n", index,
+                frame.depth);
+        ok = false;
+        goto done;
+      }
+      frame.dst->binder = binders.items[frame.depth - 1 - index];
+      frame.dst->atom = frame.dst->binder->left->atom;
+    } break;
+    case LAMBDA_ABSTRACTION: {
+      if (!tree_add_left_child(arena, frame.dst)) { ok = false; goto done; }
+      if (!tree_add_right_child(arena, frame.dst)) { ok = false; goto done; }
+      frame.dst->left->atom = term_data(node);
+      nob_da_append(&binders, frame.dst);
+      nob_da_append(&stack, ((Frame){.dst = frame.dst->right, .src = node.right, .depth = frame.depth + 1}));
+    } break;
+    case LAMBDA_APPLICATION: {
+      if (!tree_add_left_child(arena, frame.dst)) { ok = false; goto done; }
+      if (!tree_add_right_child(arena, frame.dst)) { ok = false; goto done; }
+      nob_da_append(&stack, ((Frame){.dst = frame.dst->right, .src = node.right, .depth = frame.depth}));
+      nob_da_append(&stack, ((Frame){.dst = frame.dst->left, .src = node.left, .depth = frame.depth}));
+    } break;
+    }
+  }
+
+done:
+  nob_da_free(stack);
+  nob_da_free(binders);
+  return ok;
+}
+
+/*
+ * Polynomial hash of the postorder node sequence, as in str_hash but with nodes for characters and modulo the
+ * Mersenne prime 2^61 - 1. The sequence spells out the de Bruijn term (each node knows how many children it has), and
+ * the names of bound atoms are left out, so alpha-equivalent terms hash the same.
+ */
+#define TERM_HASH_MODULUS ((UINT64_C(1) << 61) - 1)
+#define TERM_HASH_BASE (UINT64_C(0x1b873593a2f1c7d5) % TERM_HASH_MODULUS)
+
+static uint64_t term_hash_multiply(uint64_t a, uint64_t b) {
+  __extension__ typedef unsigned __int128 u128;
+  u128 product = (u128)a * b;
+  uint64_t sum = (uint64_t)(product & TERM_HASH_MODULUS) + (uint64_t)(product >> 61);
+  return sum >= TERM_HASH_MODULUS ? sum - TERM_HASH_MODULUS : sum;
+}
+
+static uint64_t term_hash_token(Term_Node node) {
+  uint64_t data = term_kind(node) == LAMBDA_ATOM ? term_data(node) : 0;
+  return ((data << TERM_KIND_BITS) | term_kind(node)) + 1;
+}
+
+/*
+ * Hashes every subterm of `root` at once: hashes[i - start] is the hash of the subterm rooted at node i, where start
+ * is term_subterm_start(store, root). Since a subterm is a contiguous range of the postorder sequence, its hash falls
+ * out of two prefix hashes, so this is one linear pass.
+ */
+void term_hashes(const Term_Store *store, Term_Index root, uint64_t *hashes) {
+  Term_Index start = term_subterm_start(store, root);
+  size_t count = root - start + 1;
+
+  // prefix[i]: hash of the first i nodes, powers[i]: base^i, starts[i]: first node of the subterm at start + i.
+  uint64_t *prefix = malloc((count + 1) * sizeof(uint64_t));
+  uint64_t *powers = malloc((count + 1) * sizeof(uint64_t));
+  Term_Index *starts = malloc(count * sizeof(Term_Index));
+  assert(prefix != NULL && powers != NULL && starts != NULL && "Out of memory");
+
+  prefix[0] = 0;
+  powers[0] = 1;
+  for (size_t i = 0; i < count; ++i) {
+    Term_Node node = store->items[start + i];
+    prefix[i + 1] = (term_hash_multiply(prefix[i], TERM_HASH_BASE) + term_hash_token(node)) % TERM_HASH_MODULUS;
+    powers[i + 1] = term_hash_multiply(powers[i], TERM_HASH_BASE);
+
+    switch (term_kind(node)) {
+    case LAMBDA_ATOM: starts[i] = i; break;
+    case LAMBDA_ABSTRACTION: starts[i] = starts[node.right - start]; break;
+    case LAMBDA_APPLICATION: starts[i] = starts[node.left - start]; break;
+    }
+
+    uint64_t before = term_hash_multiply(prefix[starts[i]], powers[i + 1 - starts[i]]);
+    hashes[i] = (prefix[i + 1] + TERM_HASH_MODULUS - before) % TERM_HASH_MODULUS;
+  }
+
+  free(prefix);
+  free(powers);
+  free(starts);
+}
+
+// Same as the last of term_hashes, without the per-subterm bookkeeping.
+uint64_t term_hash(const Term_Store *store, Term_Index root) {
+  uint64_t hash = 0;
+  for (Term_Index i = term_subterm_start(store, root); i <= root; ++i) {
+    hash = (term_hash_multiply(hash, TERM_HASH_BASE) + term_hash_token(store->items[i])) % TERM_HASH_MODULUS;
+  }
+  return hash;
+}
+
+// Alpha-equivalence: the node sequences match, up to where they are stored and the names of bound atoms.
+bool term_equal(const Term_Store *a, Term_Index a_root, const Term_Store *b, Term_Index b_root) {
+  Term_Index a_start = term_subterm_start(a, a_root);
+  Term_Index b_start = term_subterm_start(b, b_root);
+  if (a_root - a_start != b_root - b_start) return false;
+
+  for (size_t i = 0; i <= a_root - a_start; ++i) {
+    Term_Node x = a->items[a_start + i], y = b->items[b_start + i];
+    if (term_hash_token(x) != term_hash_token(y)) return false;
+    if ((x.left == TERM_NONE ? TERM_NONE : x.left - a_start) != (y.left == TERM_NONE ? TERM_NONE : y.left - b_start))
+      return false;
+    if ((x.right == TERM_NONE ? TERM_NONE : x.right - a_start) !=
+        (y.right == TERM_NONE ? TERM_NONE : y.right - b_start))
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Copies `root` (which sits under `depth` binders) from src to dst, rewriting its free atoms:
+ * - with argument == TERM_NONE, free atoms are shifted up by `shift` (the usual de Bruijn lift),
+ * - otherwise the atom bound at `depth` is replaced by `argument` (lifted to the atom's depth) and the atoms
+ *   bound further out are shifted down by one, since that binder is going away (i.e. the body of a redex).
+ * dst may be src: the copy is only ever appended and src is always read by index.
+ */
+static Term_Index term_rewrite_atoms(Term_Store *dst, const Term_Store *src, Term_Index root, uint32_t depth,
+                                     uint32_t shift, Term_Index argument) {
+  typedef struct {
+    Term_Index node;
+    uint32_t depth;
+    bool expanded;
+  } Frame;
+
+  Vec(Frame) stack = {0};
+  Vec(Term_Index) results = {0};
+
+  nob_da_append(&stack, ((Frame){.node = root, .depth = depth}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    Term_Node node = src->items[frame.node];
+
+    switch (term_kind(node)) {
+    case LAMBDA_ATOM: {
+      uint32_t index = term_data(node);
+      Term_Index result;
+      if (index < frame.depth) {
+        result = term_push_atom(dst, index);
+      } else if (argument == TERM_NONE) {
+        result = term_push_atom(dst, index + shift);
+      } else if (index == frame.depth) {
+        result = (frame.depth == 0) ? term_copy(dst, src, argument)
+                                    : term_rewrite_atoms(dst, src, argument, 0, frame.depth, TERM_NONE);
+      } else {
+        result = term_push_atom(dst, index - 1);
+      }
+      nob_da_append(&results, result);
+    } break;
+    case LAMBDA_ABSTRACTION: {
+      if (!frame.expanded) {
+        nob_da_append(&stack, ((Frame){.node = frame.node, .depth = frame.depth, .expanded = true}));
+        nob_da_append(&stack, ((Frame){.node = node.right, .depth = frame.depth + 1}));
+      } else {
+        Term_Index body = results.items[--results.count];
+        nob_da_append(&results, term_push(dst, LAMBDA_ABSTRACTION, term_data(node), TERM_NONE, body));
+      }
+    } break;
+    case LAMBDA_APPLICATION: {
+      if (!frame.expanded) {
+        nob_da_append(&stack, ((Frame){.node = frame.node, .depth = frame.depth, .expanded = true}));
+        nob_da_append(&stack, ((Frame){.node = node.right, .depth = frame.depth}));
+        nob_da_append(&stack, ((Frame){.node = node.left, .depth = frame.depth}));
+      } else {
+        Term_Index right = results.items[--results.count];
+        Term_Index left = results.items[--results.count];
+        nob_da_append(&results, term_push_application(dst, left, right));
+      }
+    } break;
+    }
+  }
+
+  Term_Index result = results.items[0];
+  nob_da_free(stack);
+  nob_da_free(results);
+  return result;
+}
+
+/*
+ * Contracts every redex of the term at `root` in src at once, writing the result to dst (which must be a different
+ * store): one step of a complete development, i.e. of Gross-Knuth reduction. Redexes that only appear once the
+ * arguments are substituted are left for the next step. Contracting (\M) N develops N once into a scratch store,
+ * then develops M with N bound in the environment, so nested redexes never go through an intermediate term.
+ * *contracted is set to the number of redexes contracted, 0 if the term is already in normal form.
+ */
+bool term_develop(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *new_root,
+                  size_t *contracted) {
+  // An environment entry either stands for a binder kept in the result or for a developed argument.
+  typedef struct Binding Binding;
+  struct Binding {
+    Term_Index value; // in values, TERM_NONE for a kept binder
+    uint32_t depth; // kept binders in the result enclosing the binder, or the place the value was developed for
+    Binding *next;
+  };
+
+  typedef enum {
+    DEVELOP_TERM,
+    DEVELOP_ABSTRACTION,
+    DEVELOP_APPLICATION,
+    DEVELOP_BODY, // the argument of a redex is on top of results, develop the body with it bound
+  } Develop_Task;
+
+  typedef struct {
+    Develop_Task task;
+    Term_Index node;
+    uint32_t depth; // kept binders enclosing the node in the result
+    Binding *env;
+    bool value; // write to values instead of dst
+  } Frame;
+
+  assert(dst != src && "A development writes the result to a separate store");
+
+  Arena arena = {0};
+  Term_Store values = {0};
+  Vec(Frame) stack = {0};
+  Vec(Term_Index) results = {0};
+
+  *contracted = 0;
+  nob_da_append(&stack, ((Frame){.task = DEVELOP_TERM, .node = root}));
+  while (stack.count > 0) {
+    Frame frame = stack.items[--stack.count];
+    Term_Store *out = frame.value ? &values : dst;
+    Term_Node node = src->items[frame.node];
+
+    switch (frame.task) {
+    case DEVELOP_TERM: {
+      switch (term_kind(node)) {
+      case LAMBDA_ATOM: {
+        uint32_t index = term_data(node);
+        Binding *binding = frame.env;
+        for (; binding != NULL && index > 0; --index) binding = binding->next;
+
+        Term_Index result;
+        if (binding == NULL) {
+          result = term_push_atom(out, frame.depth + index); // free in the whole term
+        } else if (binding->value == TERM_NONE) {
+          result = term_push_atom(out, frame.depth - 1 - binding->depth);
+        } else {
+          result = term_rewrite_atoms(out, &values, binding->value, 0, frame.depth - binding->depth, TERM_NONE);
+        }
+        nob_da_append(&results, result);
+      } break;
+      case LAMBDA_ABSTRACTION: {
+        Binding *binding = arena_alloc(&arena, sizeof(Binding));
+        *binding = (Binding){.value = TERM_NONE, .depth = frame.depth, .next = frame.env};
+        nob_da_append(&stack, ((Frame){.task = DEVELOP_ABSTRACTION, .node = frame.node, .value = frame.value}));
+        nob_da_append(&stack, ((Frame){.task = DEVELOP_TERM, .node = node.right, .depth = frame.depth + 1,
+                                       .env = binding, .value = frame.value}));
+      } break;
+      case LAMBDA_APPLICATION: {
+        Term_Node function = src->items[node.left];
+        if (term_kind(function) == LAMBDA_ABSTRACTION) {
+          *contracted += 1;
+          nob_da_append(&stack, ((Frame){.task = DEVELOP_BODY, .node = function.right, .depth = frame.depth,
+                                         .env = frame.env, .value = frame.value}));
+          nob_da_append(&stack, ((Frame){.task = DEVELOP_TERM, .node = node.right, .depth = frame.depth,
+                                         .env = frame.env, .value = true}));
+        } else {
+          nob_da_append(&stack, ((Frame){.task = DEVELOP_APPLICATION, .value = frame.value}));
+          nob_da_append(&stack, ((Frame){.task = DEVELOP_TERM, .node = node.right, .depth = frame.depth,
+                                         .env = frame.env, .value = frame.value}));
+          nob_da_append(&stack, ((Frame){.task = DEVELOP_TERM, .node = node.left, .depth = frame.depth,
+                                         .env = frame.env, .value = frame.value}));
+        }
+      } break;
+      }
+    } break;
+    case DEVELOP_ABSTRACTION: {
+      Term_Index body = results.items[--results.count];
+      nob_da_append(&results, term_push(out, LAMBDA_ABSTRACTION, term_data(node), TERM_NONE, body));
+    } break;
+    case DEVELOP_APPLICATION: {
+      Term_Index right = results.items[--results.count];
+      Term_Index left = results.items[--results.count];
+      nob_da_append(&results, term_push_application(out, left, right));
+    } break;
+    case DEVELOP_BODY: {
+      Binding *binding = arena_alloc(&arena, sizeof(Binding));
+      *binding = (Binding){.value = results.items[--results.count], .depth = frame.depth, .next = frame.env};
+      nob_da_append(&stack, ((Frame){.task = DEVELOP_TERM, .node = frame.node, .depth = frame.depth,
+                                     .env = binding, .value = frame.value}));
+    } break;
+    }
+  }
+
+  *new_root = results.items[0];
+  arena_free(&arena);
+  nob_da_free(values);
+  nob_da_free(stack);
+  nob_da_free(results);
+  return true;
+}
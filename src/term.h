@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <nob.h>
+
+#include "parser.h"
+#include "util.h"
+
+/*
+ * Flat, index-addressed representation of lambda terms.
+ *
+ * Nodes live in one contiguous array in postorder: children always come before their parent, so the root of a
+ * term is the last node pushed for it and every subterm occupies the contiguous range ending at its root. Bound
+ * variables are de Bruijn indices, so there are no binder pointers to fix up when a subterm is moved or copied.
+ * Alpha-equivalent terms have the same nodes but for the binder names abstractions keep for printing, which
+ * term_hash and term_equal leave out.
+ *
+ * A node is 12 bytes (vs. a Tree_Node's 56 on LP64), which makes whole-term traversals a linear scan over memory.
+ */
+
+typedef uint32_t Term_Index;
+#define TERM_NONE ((Term_Index)UINT32_MAX)
+
+#define TERM_KIND_BITS 2
+#define TERM_KIND_MASK ((1u << TERM_KIND_BITS) - 1)
+
+typedef struct {
+  uint32_t head; // Lambda_Expr_Kind in the low bits, the rest is kind-specific data (see term_data)
+  Term_Index left; // LAMBDA_APPLICATION: function
+  Term_Index right; // LAMBDA_APPLICATION: argument, LAMBDA_ABSTRACTION: body
+} Term_Node;
+
+typedef Vec(Term_Node) Term_Store;
+
+#define term_kind(node) ((Lambda_Expr_Kind)((node).head & TERM_KIND_MASK))
+// LAMBDA_ATOM: de Bruijn index, LAMBDA_ABSTRACTION: Symbol of the bound atom (only used when printing)
+#define term_data(node) ((node).head >> TERM_KIND_BITS)
+
+Term_Index term_push(Term_Store *store, Lambda_Expr_Kind kind, uint32_t data, Term_Index left, Term_Index right);
+Term_Index term_push_atom(Term_Store *store, uint32_t index);
+Term_Index term_push_abstraction(Term_Store *store, Symbol name, Term_Index body);
+Term_Index term_push_application(Term_Store *store, Term_Index function, Term_Index argument);
+
+Term_Index term_subterm_start(const Term_Store *store, Term_Index root);
+Term_Index term_copy(Term_Store *dst, const Term_Store *src, Term_Index root);
+uint64_t term_hash(const Term_Store *store, Term_Index root);
+void term_hashes(const Term_Store *store, Term_Index root, uint64_t *hashes);
+bool term_equal(const Term_Store *a, Term_Index a_root, const Term_Store *b, Term_Index b_root);
+
+bool term_from_tree(Term_Store *store, const Tree_Node *tree, Term_Index *root);
+bool term_to_tree(Arena *arena, Tree_Node *tree, const Term_Store *store, Term_Index root);
+
+bool term_develop(Term_Store *dst, const Term_Store *src, Term_Index root, Term_Index *new_root,
+                  size_t *contracted);
@@ -2,6 +2,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 size_t str_hash(const char* s) {
   // \sum_{i=0}^{n} s[i] * p^i mod m
@@ -15,7 +16,7 @@ size_t str_hash(const char* s) {
 
   size_t pow_p = 1;
   size_t h = 0;
-  for (size_t i = 0; i < strlen(s); ++i) {
+  for (size_t i = 0; s[i] != '\0'; ++i) {
     h += ((size_t)(s[i] - 'a' + 1) * pow_p) % m;
     pow_p = (pow_p * p) % m;
   }
@@ -23,19 +24,87 @@ size_t str_hash(const char* s) {
   return h;
 }
 
+double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Arena_Chunk *arena_new_chunk(size_t capacity) {
+  Arena_Chunk *chunk = malloc(sizeof(Arena_Chunk) + capacity);
+  if (chunk == NULL) return NULL;
+  chunk->next = NULL;
+  chunk->ptr = 0;
+  chunk->capacity = capacity;
+  return chunk;
+}
+
 bool arena_malloc_with_capacity(Arena *arena, size_t capacity) {
-  arena->base = malloc(capacity);
-  arena->ptr = 0;
-  arena->capacity = capacity;
-  return arena->base != NULL;
+  arena->first = arena_new_chunk(capacity);
+  arena->current = arena->first;
+  arena->chunk_capacity = capacity;
+  return arena->first != NULL;
 }
 
 void *arena_alloc(Arena *arena, size_t nbytes) {
-  if (arena->ptr + nbytes >= arena->capacity) {
-    return NULL;
+  const size_t align = _Alignof(max_align_t);
+  nbytes = (nbytes + align - 1) & ~(align - 1);
+
+  Arena_Chunk *chunk = arena->current;
+  if (chunk != NULL && chunk->ptr + nbytes <= chunk->capacity) {
+    void *ptr = chunk->data + chunk->ptr;
+    chunk->ptr += nbytes;
+    return ptr;
+  }
+
+  // Reuse the chunk after the current one if it was released and is big enough, otherwise splice in a new one.
+  Arena_Chunk *next = (chunk != NULL) ? chunk->next : arena->first;
+  if (next == NULL || next->capacity < nbytes) {
+    size_t capacity = arena->chunk_capacity != 0 ? arena->chunk_capacity : ARENA_DEFAULT_CHUNK_CAPACITY;
+    Arena_Chunk *fresh = arena_new_chunk(max(capacity, nbytes));
+    if (fresh == NULL) return NULL;
+    fresh->next = next;
+    if (chunk != NULL) chunk->next = fresh;
+    else arena->first = fresh;
+    next = fresh;
+  }
+
+  next->ptr = nbytes;
+  arena->current = next;
+  return next->data;
+}
+
+Arena_Mark arena_mark(const Arena *arena) {
+  Arena_Mark mark = {
+      .chunk = arena->current,
+      .ptr = (arena->current != NULL) ? arena->current->ptr : 0,
+  };
+  return mark;
+}
+
+void arena_release(Arena *arena, Arena_Mark mark) {
+  if (mark.chunk == NULL) {
+    arena_reset(arena);
+    return;
+  }
+
+  arena->current = mark.chunk;
+  arena->current->ptr = mark.ptr;
+}
+
+void arena_reset(Arena *arena) {
+  arena->current = arena->first;
+  if (arena->current != NULL) arena->current->ptr = 0;
+}
+
+void arena_free(Arena *arena) {
+  Arena_Chunk *chunk = arena->first;
+  while (chunk != NULL) {
+    Arena_Chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
   }
 
-  void *ptr = arena->base + arena->ptr;
-  arena->ptr += nbytes;
-  return ptr;
+  arena->first = NULL;
+  arena->current = NULL;
 }
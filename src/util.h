@@ -38,12 +38,36 @@
 #define SB_Arg(sv) (int)(sv).count, (sv).items
 
 size_t str_hash(const char* str);
+double now_seconds(void);
 
-typedef struct {
-  char *base;
+/*
+ * Growable bump allocator made of a linked list of chunks. Nothing is freed individually; instead a position can
+ * be saved with arena_mark and everything allocated after it dropped at once with arena_release. Released
+ * chunks are kept around and reused by later allocations.
+ */
+typedef struct Arena_Chunk {
+  struct Arena_Chunk *next;
   size_t ptr;
   size_t capacity;
+  char data[];
+} Arena_Chunk;
+
+typedef struct {
+  Arena_Chunk *first;
+  Arena_Chunk *current;
+  size_t chunk_capacity; // minimum capacity of newly allocated chunks, ARENA_DEFAULT_CHUNK_CAPACITY if 0
 } Arena;
 
+typedef struct {
+  Arena_Chunk *chunk;
+  size_t ptr;
+} Arena_Mark;
+
+#define ARENA_DEFAULT_CHUNK_CAPACITY (64 * 1024)
+
 bool arena_malloc_with_capacity(Arena *arena, size_t capacity);
 void *arena_alloc(Arena *arena, size_t nbytes);
+Arena_Mark arena_mark(const Arena *arena);
+void arena_release(Arena *arena, Arena_Mark mark);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);